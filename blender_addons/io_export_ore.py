@@ -137,6 +137,11 @@ def add_scene_objs_to_node(tgt_node, desc_doc, objs):
         rot_node.appendChild(desc_doc.createTextNode(t2s(genRotMatrix(obj.rotation_euler))))
         obj_node.appendChild(rot_node)
 
+        # Surface parameters for contacts can be overridden with custom properties on the object
+        for prop in ("friction", "bounce"):
+          if prop in obj:
+            obj_node.setAttribute(prop, str(float(obj[prop])))
+
         libDataMatch = re.match(r"LIB(.+?)(?:\.\d+)?$", obj.data.name)
         if obj.type == "SURFACE":
           # At the moment, the only thing surfaces are used for are bubbles
@@ -57,13 +57,19 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include "mouse_cursor.h"
 #include "options_menu_mode.h"
 #include "performance.h"
+#include "recording.h"
+#include "state_hash.h"
 #include "saving.h"
 #include "sim.h"
+#include "streaming.h"
 #include "ore.h"
 
 // How often in ticks to update the performance info string
 const unsigned int MAX_PERF_INFO_AGE = 200;
 
+// How many steps to simulate each frame when replaying at maximum speed
+const unsigned int MAX_SPEED_REPLAY_STEPS_PER_FRAME = 600;
+
 const Uint32 INIT_FLAGS_FOR_SDL = SDL_INIT_TIMER | SDL_INIT_VIDEO | SDL_INIT_JOYSTICK;
 
 void App::frame_loop() {
@@ -105,9 +111,11 @@ void App::frame_loop() {
     }
     
     // This is where the important stuff happens, depending on what mode the game currently is
-    unsigned int steps_to_simulate = unsimulated_ticks / MIN_TICKS_PER_FRAME;
+    // A maximum speed replay ignores the clock; only one frame is drawn per large batch of steps
+    bool max_speed = Recording::is_replaying() and Recording::is_max_speed();
+    unsigned int steps_to_simulate = max_speed ? MAX_SPEED_REPLAY_STEPS_PER_FRAME : unsimulated_ticks / MIN_TICKS_PER_FRAME;
     Globals::mode_stack->execute_frame(steps_to_simulate);
-    unsimulated_ticks -= steps_to_simulate * MIN_TICKS_PER_FRAME;
+    unsimulated_ticks = max_speed ? 0 : unsimulated_ticks - steps_to_simulate * MIN_TICKS_PER_FRAME;
     
     // If showFps config flag is enabled, calculate and display recent FPS
     if (Saving::get().config().showFps()) {
@@ -120,6 +128,7 @@ void App::frame_loop() {
       GUI::draw_diamond_box(Box(pos, Size(Globals::sys_font->get_width(height, perf_info), height) + GUI::DIAMOND_BOX_BORDER*2));
       glColor3f(1.0, 1.0, 1.0);
       Globals::sys_font->draw(pos + GUI::DIAMOND_BOX_BORDER, height, perf_info);
+      GUI::Batch::flush();
     }
     
     // Output frame and flip buffers
@@ -128,7 +137,7 @@ void App::frame_loop() {
     
     // Sleep if we're running faster than our maximum fps
     unsigned int frame_ticks = SDL_GetTicks() - frame_start;
-    if (frame_ticks > 0 && frame_ticks < MIN_TICKS_PER_FRAME) {
+    if (frame_ticks > 0 && frame_ticks < MIN_TICKS_PER_FRAME && !max_speed) {
       SDL_Delay(MIN_TICKS_PER_FRAME - frame_ticks); // Slow down, buster!
     }
     
@@ -173,6 +182,7 @@ void App::run(const std::vector<std::string>& args) {
       }
       
       Saving::save();
+      StateHash::finish();
     } catch (const DisplayModeResetException& e) {
       display_mode_reset = true;
     }
@@ -197,6 +207,13 @@ void App::init(const std::vector<std::string>& args, bool display_mode_reset) {
     ("windowed,w", "run game in windowed mode (defaults to 800x600)")
     ("area,a", boost::program_options::value<unsigned int>(), "preselect numbered area to play")
     ("mission,m", boost::program_options::value<unsigned int>(), "preselect numbered mission to play, you must also specify --area")
+    ("record", boost::program_options::value<std::string>(), "record input during the next mission played to the given file")
+    ("replay", boost::program_options::value<std::string>(), "replay a recording made with --record")
+    ("max-speed", "with --replay, simulate as fast as possible and quit when the replay ends")
+    ("hash-log", boost::program_options::value<std::string>(), "write a hash of the simulation state at every step to the given file")
+    ("hash-compare", boost::program_options::value<std::string>(), "compare the simulation state at every step against a file made with --hash-log")
+    ("trajectory-log", boost::program_options::value<std::string>(), "write the position and velocity of every dynamic object at every step to the given file")
+    ("bench-background", "time drawing the starbox and star against the old immediate mode drawing, and log the results")
   ;
   boost::program_options::options_description hidden_opt_desc;
   hidden_opt_desc.add_options()
@@ -214,6 +231,9 @@ void App::init(const std::vector<std::string>& args, bool display_mode_reset) {
     if (vm.count("mission") and not vm.count("area")) {
       throw GameException("mission specified but no area specified");
     }
+    if (vm.count("max-speed") and not vm.count("replay")) {
+      throw GameException("max-speed specified but no replay specified");
+    }
   } catch (const std::exception& e) {
     throw GameException(std::string("Invalid arguments: ") + e.what());
   }
@@ -270,6 +290,7 @@ void App::init(const std::vector<std::string>& args, bool display_mode_reset) {
   Debug::enable_logging();
   Debug::status_msg("");
   Debug::status_msg(std::string("Orbit Ribbon ") + APP_VERSION + " starting...");
+  Debug::status_msg(std::string("Physics simulated with ") + (sizeof(dReal) == sizeof(float) ? "single" : "double") + " precision ODE");
 
   // Initialize SDL
   if (SDL_Init(INIT_FLAGS_FOR_SDL) < 0) {
@@ -306,9 +327,27 @@ void App::init(const std::vector<std::string>& args, bool display_mode_reset) {
   h3dSetupCameraView(Globals::cam, 45.0f, (float)Display::get_screen_width()/Display::get_screen_height(), 0.5f, 2048.0f);
   h3dResizePipelineBuffers(Globals::pipeRes, Display::get_screen_width(), Display::get_screen_height());
 
+  if (vm.count("record") and not display_mode_reset) {
+    Recording::set_record_path(boost::filesystem::system_complete(vm["record"].as<std::string>()));
+  }
+  if (vm.count("hash-log") and not display_mode_reset) {
+    StateHash::set_log_path(boost::filesystem::system_complete(vm["hash-log"].as<std::string>()));
+  }
+  if (vm.count("hash-compare") and not display_mode_reset) {
+    StateHash::set_compare_path(boost::filesystem::system_complete(vm["hash-compare"].as<std::string>()));
+  }
+  if (vm.count("trajectory-log") and not display_mode_reset) {
+    StateHash::set_trajectory_path(boost::filesystem::system_complete(vm["trajectory-log"].as<std::string>()));
+  }
+  if (vm.count("replay") and not display_mode_reset) {
+    Recording::start_replay(boost::filesystem::system_complete(vm["replay"].as<std::string>()), vm.count("max-speed"));
+  }
+  
   boost::filesystem::path orePath;
   bool orePathSave = false;
-  if (vm.count("ore")) {
+  if (Recording::is_replaying()) {
+    orePath = boost::filesystem::path(Recording::get_replay_ore_path());
+  } else if (vm.count("ore")) {
     orePathSave = true;
     orePath = boost::filesystem::system_complete(vm["ore"].as<std::string>());
   } else {
@@ -334,10 +373,14 @@ void App::init(const std::vector<std::string>& args, bool display_mode_reset) {
   }
 
   Sim::init();
+  Streaming::init();
   Input::init();
 
   Globals::sys_font.reset(new Font(FONTDATA_LATINMODERN, FONTDATA_LATINMODERN_LEN, FONTDATA_LATINMODERN_DESC));
   Globals::bg.reset(new Background);
+  if (vm.count("bench-background")) {
+    Globals::bg->benchmark_draws();
+  }
   Globals::mouse_cursor.reset(new MouseCursor());
   Globals::mode_stack.reset(new ModeStack());
 
@@ -345,6 +388,9 @@ void App::init(const std::vector<std::string>& args, bool display_mode_reset) {
     Globals::mode_stack->next_frame_push_mode(boost::shared_ptr<Mode>(new MainMenuMode()));
     Globals::mode_stack->next_frame_push_mode(boost::shared_ptr<Mode>(new OptionsMenuMode(true)));
     Globals::mode_stack->next_frame_push_mode(boost::shared_ptr<Mode>(new DisplaySettingsMenuMode()));
+  } else if (Recording::is_replaying()) {
+    load_mission(Recording::get_replay_area(), Recording::get_replay_mission());
+    Globals::mode_stack->next_frame_push_mode(boost::shared_ptr<Mode>(new GameplayMode()));
   } else if (vm.count("area") and vm.count("mission")) {
     unsigned int area = vm["area"].as<unsigned int>();
     unsigned int mission = vm["mission"].as<unsigned int>();
@@ -381,6 +427,7 @@ void App::deinit() {
   Globals::sys_font.reset(NULL);
 
   Input::deinit();
+  Streaming::deinit();
   Sim::deinit();
   
   Globals::libscenes.clear();
@@ -449,15 +496,19 @@ void App::load_mission(unsigned int area_num, unsigned int mission_num) {
   // Another possible idea: Have orbit-edit.py notice common objects/textures among all or nearly all missions, then we
   // can load them on ORE load.
   Globals::gameobjs.clear();
+  Sim::reset_origin();
+  Sim::clear_lod_focus();
+  std::vector<const ORE1::ObjType*> objs;
   if (mission) {
     for (ORE1::MissionType::obj_const_iterator i = mission->obj().begin(); i != mission->obj().end(); ++i) {
-      Globals::gameobjs.insert(GOMap::value_type(i->objName(), get_factory<GameObjFactorySpec>().create(*i)));
+      objs.push_back(&(*i));
     }
   } else {
     for (ORE1::AreaType::obj_const_iterator i = area->obj().begin(); i != area->obj().end(); ++i) {
-      Globals::gameobjs.insert(GOMap::value_type(i->objName(), get_factory<GameObjFactorySpec>().create(*i)));
+      objs.push_back(&(*i));
     }
   }
+  Streaming::load(objs);
   
   Globals::bg->set_sky(area->sky());
   
@@ -36,8 +36,11 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include "mesh.h"
 #include "saving.h"
 #include "sim.h"
+#include "snapshot.h"
+#include "trigger.h"
 
 AutoRegistration<GameObjFactorySpec, AvatarGameObj> avatar_gameobj_reg("Avatar");
+SimLodRegistration avatar_sim_lod_reg("Avatar", SimLodPolicy::full_rate());
 
 // Maximum amount of Newtons per second applied by various maneuvers
 // FIXME Wait, Newtons per second? That doesn't make sense. Figure out what unit I really mean.
@@ -137,14 +140,13 @@ bool AvatarGameObj::check_attachment(float yp_delta, const Vector& sn) {
 bool AvatarGameObj::AvatarContactHandler::handle_collision(
   float t __attribute__ ((unused)),
   dGeomID o __attribute__ ((unused)),
-  const dContactGeom* c,
-  unsigned int c_len __attribute__ ((unused))
+  const ContactView& c
 )  {
-  float ypd = c[0].depth;
-  Vector sn(c[0].normal);
-  const GLOOBufferedMesh* mesh = GLOOBufferedMesh::get_mesh_from_geom(c[0].g2);
+  float ypd = c.depth(0);
+  Vector sn(c.normal(0));
+  const CollisionMesh* mesh = CollisionMesh::get_from_geom(c.g2(0));
   if (mesh != 0) {
-    sn = mesh->get_interpolated_normal(c[0].g2, Point(c[0].pos), c[0].side2);
+    sn = mesh->get_interpolated_normal(c.g2(0), c.pos(0), c.side2(0));
   }
   
   if (_avatar->check_attachment(ypd, sn)) {
@@ -152,7 +154,7 @@ bool AvatarGameObj::AvatarContactHandler::handle_collision(
     return false;
   } else {
     Point feet_center(_avatar->get_pos() - _avatar->vector_to_world(Vector(0, _avatar->_height/2, 0)));
-    Point coll = Point(c[0].pos);
+    Point coll = c.pos(0);
     if (
       _avatar->get_last_run_coll_age() <= DETACH_GRACE_PERIOD_TIME_STEPS &&
       feet_center.sq_dist_to(coll) <= DETACH_GRACE_PERIOD_RADIUS_SQ
@@ -168,14 +170,13 @@ bool AvatarGameObj::AvatarContactHandler::handle_collision(
 bool AvatarGameObj::StickyAttachmentContactHandler::handle_collision(
   float t __attribute__ ((unused)),
   dGeomID o __attribute__ ((unused)),
-  const dContactGeom* c,
-  unsigned int c_len  __attribute__ ((unused))
+  const ContactView& c
 ) {
-  float ypd = -c[0].depth + RUNNING_MAX_DELTA_Y_POS;
-  Vector sn(c[0].normal);
-  const GLOOBufferedMesh* mesh = GLOOBufferedMesh::get_mesh_from_geom(c[0].g2);
+  float ypd = -c.depth(0) + RUNNING_MAX_DELTA_Y_POS;
+  Vector sn(c.normal(0));
+  const CollisionMesh* mesh = CollisionMesh::get_from_geom(c.g2(0));
   if (mesh != 0) {
-    sn = mesh->get_interpolated_normal(c[0].g2, Point(c[0].pos), c[0].side2);
+    sn = mesh->get_interpolated_normal(c.g2(0), c.pos(0), c.side2(0));
   }
   
   _avatar->check_attachment(ypd, sn);
@@ -307,11 +308,60 @@ void AvatarGameObj::step_impl() {
   }
 }
 
+void AvatarGameObj::save_state_impl(SnapshotBuffer& buf) const {
+  buf.write(_sn);
+  buf.write(_xrot_delta);
+  buf.write(_zrot_delta);
+  buf.write(_ypos_delta);
+  buf.write(_ylvel_delta);
+  buf.write(_xavel_delta);
+  buf.write(_zavel_delta);
+  buf.write(_norm_coll_steptime);
+  buf.write(_run_coll_steptime);
+  buf.write(_uprightness);
+  buf.write(_attached);
+  buf.write(_attached_this_frame);
+  buf.write((bool)dGeomIsEnabled(get_entity().get_geom("sticky_attach")));
+}
+
+void AvatarGameObj::restore_state_impl(SnapshotBuffer& buf) {
+  buf.read(_sn);
+  buf.read(_xrot_delta);
+  buf.read(_zrot_delta);
+  buf.read(_ypos_delta);
+  buf.read(_ylvel_delta);
+  buf.read(_xavel_delta);
+  buf.read(_zavel_delta);
+  buf.read(_norm_coll_steptime);
+  buf.read(_run_coll_steptime);
+  buf.read(_uprightness);
+  buf.read(_attached);
+  buf.read(_attached_this_frame);
+  bool sticky_enabled;
+  buf.read(sticky_enabled);
+  if (sticky_enabled) {
+    dGeomEnable(get_entity().get_geom("sticky_attach"));
+  } else {
+    dGeomDisable(get_entity().get_geom("sticky_attach"));
+  }
+  
+  update_geom_offsets();
+}
+
 void AvatarGameObj::near_draw_impl() {
   glRotatef(-_uprightness*90, 1, 0, 0);
   _mesh->draw();  
 }
 
+float AvatarGameObj::get_bounding_radius() const {
+  // The uprightness rotation is about the mesh origin, so it doesn't change the radius
+  return _mesh->get_bounding_radius();
+}
+
+RenderState AvatarGameObj::get_render_state() const {
+  return _mesh->get_render_state();
+}
+
 AvatarGameObj::AvatarGameObj(const ORE1::ObjType& obj) :
   GameObj(obj, Sim::gen_sphere_body(80, 0.5)), // TODO Load mass information from the ORE mission description
   _xrot_delta(0.0),
@@ -349,9 +399,17 @@ AvatarGameObj::AvatarGameObj(const ORE1::ObjType& obj) :
   dQuaternion rdq;
   dQFromAxisAndAngle(rdq, 1, 0, 0, M_PI_2);
   dGeomSetOffsetQuaternion(get_entity().get_geom("sticky_attach"), rdq);
+  dGeomRaySetClosestHit(get_entity().get_geom("sticky_attach"), 1); // Only one contact is generated against sensors, so it should be the nearest one
   dGeomDisable(get_entity().get_geom("sticky_attach"));
   
   update_geom_offsets();
+  
+  // The avatar is what passes through target rings and sets off other trigger volumes
+  Triggers::add_activator(this);
+}
+
+AvatarGameObj::~AvatarGameObj() {
+  Triggers::remove_activator(this);
 }
 
 unsigned int AvatarGameObj::get_last_norm_coll_age() {
@@ -75,8 +75,8 @@ class AvatarGameObj : public GameObj {
         AvatarGameObj* _avatar;
         
       public:
-        AvatarContactHandler(AvatarGameObj* avatar) : _avatar(avatar) {}
-        bool handle_collision(float t, dGeomID o, const dContactGeom* c, unsigned int c_len);
+        AvatarContactHandler(AvatarGameObj* avatar) : SimpleContactHandler(ACTIVE), _avatar(avatar) {}
+        bool handle_collision(float t, dGeomID o, const ContactView& c);
     };
     
     class StickyAttachmentContactHandler : public SimpleContactHandler {
@@ -84,16 +84,22 @@ class AvatarGameObj : public GameObj {
         AvatarGameObj* _avatar;
         
       public:
-        StickyAttachmentContactHandler(AvatarGameObj* avatar) : _avatar(avatar) {}
-        bool handle_collision(float t, dGeomID o, const dContactGeom* c, unsigned int c_len);
+        StickyAttachmentContactHandler(AvatarGameObj* avatar) : SimpleContactHandler(SENSOR), _avatar(avatar) {}
+        bool handle_collision(float t, dGeomID o, const ContactView& c);
     };
     
   protected:
     void step_impl();
     void near_draw_impl();
+    void save_state_impl(SnapshotBuffer& buf) const;
+    void restore_state_impl(SnapshotBuffer& buf);
   
   public:
     AvatarGameObj(const ORE1::ObjType& obj);
+    ~AvatarGameObj();
+    
+    float get_bounding_radius() const;
+    RenderState get_render_state() const;
     
     float get_last_xrot() { return _xrot_delta; }
     float get_last_zrot() { return _zrot_delta; }
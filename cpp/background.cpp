@@ -21,16 +21,23 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 */
 
 #include <cmath>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/foreach.hpp>
+#include <boost/format.hpp>
 #include <boost/random.hpp>
+#include <SDL/SDL.h>
+#include <SDL/SDL_image.h>
 //#include <GL/glew.h>
 
 #include "autoxsd/orepkgdesc.h"
 #include "background.h"
+#include "debug.h"
 #include "except.h"
 #include "geometry.h"
-
+#include "globals.h"
 #include "mesh.h"
+#include "ore.h"
+#include "sim.h"
 
 // Settings for the main star
 const float STAR_DIST = 5e10; // Distance from center of star to densest part of the Ribbon belt 
@@ -49,8 +56,49 @@ const float STARBOX_DIST = 1e12;
 // Settings for generation of ribbon background stuff (i.e. distant bubbles)
 const unsigned int RANDOM_STUFF_MASTER_SEED = 827342;
 const unsigned int RANDOM_STUFF_SEED_COEF = 67344;
+
+// How many times benchmark_draws repeats each way of drawing
+const unsigned int BENCHMARK_DRAWS = 200;
+
+// How each starmap image used to be placed: rotated from the +z face by an angle about an axis, with its
+// texture coordinates turned by a number of corners
+struct StarmapFace {
+  float angle;
+  float axis_x, axis_y;
+  unsigned int uv_offset;
+};
+const StarmapFace STARMAP_FACES[6] = {
+  {   0, 0, 1, 0 },
+  { -90, 0, 1, 0 },
+  { 180, 0, 1, 0 },
+  {  90, 1, 0, 1 },
+  {  90, 0, 1, 2 },
+  { -90, 1, 0, 3 }
+};
+const float STARMAP_UV[8] = {
+  1.0, 0.0,
+  0.0, 0.0,
+  0.0, 1.0,
+  1.0, 1.0
+};
+
+// The sky cube, as quads wound to face inwards, with each vertex's cube map texture coordinate being its own position
+const float SKY_CUBE_VERTS[72] = {
+  +1, -1, +1,  +1, +1, +1,  +1, +1, -1,  +1, -1, -1,
+  -1, -1, -1,  -1, +1, -1,  -1, +1, +1,  -1, -1, +1,
+  +1, +1, -1,  +1, +1, +1,  -1, +1, +1,  -1, +1, -1,
+  +1, -1, +1,  +1, -1, -1,  -1, -1, -1,  -1, -1, +1,
+  -1, +1, +1,  +1, +1, +1,  +1, -1, +1,  -1, -1, +1,
+  +1, +1, -1,  -1, +1, -1,  -1, -1, -1,  +1, -1, -1
+};
+
 std::vector<Background::RandomStuffDensityRange> Background::density_ranges;
 
+// Milliseconds since start, at microsecond resolution
+double ms_since(const boost::posix_time::ptime& start) {
+  return (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds()/1000.0;
+}
+
 void Background::init() {
   glEnable(GL_LIGHT1); glLightfv(GL_LIGHT1, GL_DIFFUSE, STAR_LIGHT_DIFFUSE);
   glEnable(GL_LIGHT2); glLightfv(GL_LIGHT2, GL_DIFFUSE, AMB_LIGHT_DIFFUSE);
@@ -73,14 +121,203 @@ void Background::deinit() {
 
 Background::Background() :
   _star_tex(GLOOTexture::load("star.png")),
-  _distant_bubble(MeshAnimation::load("mesh-LIBDistantBubble"))
+  _distant_bubble(MeshAnimation::load("mesh-LIBDistantBubble")),
+  _sky_cubemap(0),
+  _view_fwd(0, 0, 1),
+  _view_up(0, 1, 0),
+  _bubble_list(0)
 {
-  _starbox_faces.push_back(GLOOTexture::load("starmap-1.png"));
-  _starbox_faces.push_back(GLOOTexture::load("starmap-2.png"));
-  _starbox_faces.push_back(GLOOTexture::load("starmap-3.png"));
-  _starbox_faces.push_back(GLOOTexture::load("starmap-4.png"));
-  _starbox_faces.push_back(GLOOTexture::load("starmap-5.png"));
-  _starbox_faces.push_back(GLOOTexture::load("starmap-6.png"));
+  build_sky_cubemap();
+  generate_bubbles();
+}
+
+Background::~Background() {
+  if (_bubble_list != 0) {
+    glDeleteLists(_bubble_list, 1);
+  }
+  if (_sky_cubemap != 0) {
+    glDeleteTextures(1, &_sky_cubemap);
+  }
+}
+
+// Rotates v by angle degrees about the x or y axis, the same way glRotatef would
+Vector rotate_about_axis(const Vector& v, float angle, float axis_x, float axis_y) {
+  float s = std::sin(deg2rad(angle));
+  float c = std::cos(deg2rad(angle));
+  if (axis_x > 0) {
+    return Vector(v.x, c*v.y - s*v.z, s*v.y + c*v.z);
+  } else if (axis_y > 0) {
+    return Vector(c*v.x + s*v.z, v.y, -s*v.x + c*v.z);
+  }
+  return v;
+}
+
+// Loads an image out of the ORE package as tightly packed RGBA rows, first row first
+SDL_Surface* load_rgba_image(const std::string& name) {
+  boost::shared_ptr<OreFileData> data = Globals::ore->get_data(name);
+  SDL_Surface* img = IMG_Load_RW(data->get_const_sdl_rwops(), 0);
+  if (!img) {
+    throw GameException("Unable to load image " + name + " : " + IMG_GetError());
+  }
+  
+  #if SDL_BYTEORDER == SDL_BIG_ENDIAN
+  SDL_Surface* rgba = SDL_CreateRGBSurface(SDL_SWSURFACE, img->w, img->h, 32, 0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff);
+  #else
+  SDL_Surface* rgba = SDL_CreateRGBSurface(SDL_SWSURFACE, img->w, img->h, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+  #endif
+  SDL_SetAlpha(img, 0, 0); // Copy the alpha channel rather than blending with it
+  SDL_BlitSurface(img, NULL, rgba, NULL);
+  SDL_FreeSurface(img);
+  return rgba;
+}
+
+// Bilinearly samples an RGBA surface at the given texture coordinates, clamped at the edges
+void sample_rgba(const SDL_Surface* img, float u, float v, unsigned char* out) {
+  float x = std::max(0.0f, std::min(u*img->w - 0.5f, img->w - 1.0f));
+  float y = std::max(0.0f, std::min(v*img->h - 0.5f, img->h - 1.0f));
+  int x0 = int(x), y0 = int(y);
+  int x1 = std::min(x0 + 1, img->w - 1), y1 = std::min(y0 + 1, img->h - 1);
+  float fx = x - x0, fy = y - y0;
+  
+  const unsigned char* p = static_cast<const unsigned char*>(img->pixels);
+  const unsigned char* p00 = p + y0*img->pitch + x0*4;
+  const unsigned char* p10 = p + y0*img->pitch + x1*4;
+  const unsigned char* p01 = p + y1*img->pitch + x0*4;
+  const unsigned char* p11 = p + y1*img->pitch + x1*4;
+  for (unsigned int c = 0; c < 4; ++c) {
+    float top = p00[c] + (p10[c] - p00[c])*fx;
+    float bottom = p01[c] + (p11[c] - p01[c])*fx;
+    out[c] = static_cast<unsigned char>(top + (bottom - top)*fy + 0.5);
+  }
+}
+
+void Background::build_sky_cubemap() {
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  
+  std::vector<SDL_Surface*> faces;
+  for (unsigned int i = 0; i < 6; ++i) {
+    faces.push_back(load_rgba_image((boost::format("starmap-%u.png") % (i + 1)).str()));
+    SDL_LockSurface(faces.back());
+  }
+  
+  glGenTextures(1, &_sky_cubemap);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, _sky_cubemap);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  
+  // Each cube map texel is filled in from whichever starmap image used to be drawn in its direction, at the
+  // texture coordinates that image's quad had there, so the sky looks the way it did with six separate quads
+  int size = faces[0]->w;
+  std::vector<unsigned char> texels(size*size*4);
+  for (unsigned int f = 0; f < 6; ++f) {
+    for (int t = 0; t < size; ++t) {
+      for (int s = 0; s < size; ++s) {
+        float sc = (s + 0.5)/size*2 - 1;
+        float tc = (t + 0.5)/size*2 - 1;
+        Vector dir;
+        switch (f) {
+          case 0: dir = Vector(1, -tc, -sc); break; // +X
+          case 1: dir = Vector(-1, -tc, sc); break; // -X
+          case 2: dir = Vector(sc, 1, tc); break; // +Y
+          case 3: dir = Vector(sc, -1, -tc); break; // -Y
+          case 4: dir = Vector(sc, -tc, 1); break; // +Z
+          default: dir = Vector(-sc, -tc, -1); break; // -Z
+        }
+        
+        for (unsigned int i = 0; i < 6; ++i) {
+          const StarmapFace& sf = STARMAP_FACES[i];
+          Vector w = rotate_about_axis(dir, -sf.angle, sf.axis_x, sf.axis_y);
+          if (w.z <= 0 or std::fabs(w.x) > w.z or std::fabs(w.y) > w.z) {
+            continue;
+          }
+          
+          // Position across the quad from its (-d, +d) corner, then the texture coordinates interpolated between its corners
+          float fx = (w.x/w.z + 1)/2;
+          float fy = (1 - w.y/w.z)/2;
+          const float* uv0 = STARMAP_UV + ((sf.uv_offset + 0)%4)*2;
+          const float* uv1 = STARMAP_UV + ((sf.uv_offset + 1)%4)*2;
+          const float* uv2 = STARMAP_UV + ((sf.uv_offset + 2)%4)*2;
+          const float* uv3 = STARMAP_UV + ((sf.uv_offset + 3)%4)*2;
+          float u = (1-fx)*(1-fy)*uv0[0] + fx*(1-fy)*uv1[0] + fx*fy*uv2[0] + (1-fx)*fy*uv3[0];
+          float v = (1-fx)*(1-fy)*uv0[1] + fx*(1-fy)*uv1[1] + fx*fy*uv2[1] + (1-fx)*fy*uv3[1];
+          sample_rgba(faces[i], u, v, &texels[(t*size + s)*4]);
+          break;
+        }
+      }
+    }
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texels[0]);
+  }
+  
+  BOOST_FOREACH(SDL_Surface* face, faces) {
+    SDL_UnlockSurface(face);
+    SDL_FreeSurface(face);
+  }
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  
+  Debug::debug_msg((boost::format("Built %ux%u sky cube map in %.3f ms") % size % size % ms_since(start)).str());
+}
+
+
+void Background::generate_bubbles() {
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  
+  // The seeding and the order of draws from the generator are what they were when this ran every frame,
+  // so the field looks the same as it always has
+  _bubbles.clear();
+  unsigned int seed_offset = RANDOM_STUFF_MASTER_SEED;
+  BOOST_FOREACH(const RandomStuffDensityRange& r, density_ranges) {
+    boost::binomial_distribution<unsigned int, float> count_dist(r.total_count, 1.0/r.segments);
+    boost::variate_generator<boost::taus88&, boost::binomial_distribution<unsigned int, float> > count_die(_random_gen, count_dist);
+    
+    boost::uniform_real<float> radius_dist(r.rad_min, r.rad_max);
+    boost::variate_generator<boost::taus88&, boost::uniform_real<float> > radius_die(_random_gen, radius_dist);
+    
+    boost::uniform_real<float> pos_dist(0.0, 1.0/r.segments);
+    boost::variate_generator<boost::taus88&, boost::uniform_real<float> > pos_die(_random_gen, pos_dist);
+    
+    boost::normal_distribution<float> d_offset_dist(0, r.d_sigma);
+    boost::variate_generator<boost::taus88&, boost::normal_distribution<float> > d_offset_die(_random_gen, d_offset_dist);
+    
+    boost::normal_distribution<float> y_offset_dist(0, r.d_sigma);
+    boost::variate_generator<boost::taus88&, boost::normal_distribution<float> > y_offset_die(_random_gen, y_offset_dist);
+    
+    for (unsigned int s = 0; s < r.segments; ++s) {
+      _random_gen.seed((seed_offset + s)*RANDOM_STUFF_SEED_COEF);
+      unsigned int count = count_die();
+      float start_angle = s*(1.0/r.segments);
+      for (unsigned int i = 0; i < count; ++i) {
+        BubbleInstance b;
+        float pos_angle = rev2rad(start_angle + pos_die());
+        float d = STAR_DIST + d_offset_die();
+        b.x = d*std::sin(pos_angle);
+        b.y = y_offset_die();
+        b.z = d*std::cos(pos_angle);
+        b.scale = radius_die();
+        _bubbles.push_back(b);
+      }
+    }
+    seed_offset += r.segments;
+  }
+  
+  Debug::debug_msg((boost::format("Generated %u distant bubbles in %.3f ms, formerly spent on every frame")
+    % _bubbles.size() % ms_since(start)
+  ).str());
+}
+
+void Background::compile_bubble_list() {
+  // Recording the draws into a display list lets the whole field go to GL as a single call each frame
+  _bubble_list = glGenLists(1);
+  glNewList(_bubble_list, GL_COMPILE);
+  BOOST_FOREACH(const BubbleInstance& b, _bubbles) {
+    GLOOPushedMatrix pm;
+    glTranslatef(b.x, b.y, b.z);
+    glScalef(b.scale, b.scale, b.scale);
+    _distant_bubble->draw();
+  }
+  glEndList();
 }
 
 void Background::set_sky(const ORE1::SkySettingsType& sky) {
@@ -91,80 +328,43 @@ void Background::set_sky(const ORE1::SkySettingsType& sky) {
   _sky_offset.z = d*std::cos(-rev2rad(sky.orbitAngle()));
 }
 
+void Background::set_view(const Vector& fwd, const Vector& up) {
+  _view_fwd = fwd.to_length(1.0);
+  _view_up = up;
+}
+
 void Background::draw_starbox() {
   GLOOPushedMatrix pm;
 
-  // Remove translation; stars are so far away that movement shouldn't change their apparent location
-  float modelview[16];
-  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
-  modelview[12] = modelview[13] = modelview[14] = 0.0;
-  glLoadMatrixf(modelview);
+  // Look along the camera's direction from the origin; stars are so far away that movement shouldn't change their apparent location
+  glLoadIdentity();
+  gluLookAt(0, 0, 0, _view_fwd.x, _view_fwd.y, _view_fwd.z, _view_up.x, _view_up.y, _view_up.z);
+  glScalef(STARBOX_DIST, STARBOX_DIST, STARBOX_DIST);
 
   glDisable(GL_LIGHTING);
   glDisable(GL_DEPTH_TEST);
+  glDisable(GL_TEXTURE_2D);
+  glEnable(GL_TEXTURE_CUBE_MAP);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, _sky_cubemap);
 
-  // Draw the starbox
-  const static float uv[8] = {
-    1.0, 0.0,
-    0.0, 0.0,
-    0.0, 1.0,
-    1.0, 1.0
-  };
-  const static float d = STARBOX_DIST;
-  for (int i = 0; i < 6; ++i) {
-    GLOOPushedMatrix pm;
-    unsigned int uv_offset = 0;
-    switch(i) {
-      case 0:
-        break;
-      case 1:
-        glRotatef(-90, 0, 1, 0);
-        break;
-      case 2:
-        glRotatef(180, 0, 1, 0);
-        break;
-      case 3:
-        glRotatef(90, 1, 0, 0);
-        uv_offset = 1;
-        break;
-      case 4:
-        glRotatef(90, 0, 1, 0);
-        uv_offset = 2;
-        break;
-      case 5:
-        glRotatef(-90, 1, 0, 0);
-        uv_offset = 3;
-        break;
-    }
-
-    _starbox_faces[i]->bind();
-    glBegin(GL_QUADS);
-    glTexCoord2fv(uv + ((uv_offset+0)%4)*2);
-    glVertex3f(-d, +d, +d);
-    glTexCoord2fv(uv + ((uv_offset+1)%4)*2);
-    glVertex3f(+d, +d, +d);
-    glTexCoord2fv(uv + ((uv_offset+2)%4)*2);
-    glVertex3f(+d, -d, +d);
-    glTexCoord2fv(uv + ((uv_offset+3)%4)*2);
-    glVertex3f(-d, -d, +d);
-    glEnd();
-  }
-
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_COLOR_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, SKY_CUBE_VERTS);
+  glTexCoordPointer(3, GL_FLOAT, 0, SKY_CUBE_VERTS);
+  glDrawArrays(GL_QUADS, 0, 24);
+  glPopClientAttrib();
+  
+  glDisable(GL_TEXTURE_CUBE_MAP);
+  glEnable(GL_TEXTURE_2D);
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_LIGHTING);
 }
 
 void Background::draw_objects() {
-  // Draw this system's star
-  glDisable(GL_LIGHTING);
-  glEnable(GL_POINT_SPRITE);
-  _star_tex->bind();
-  glPointSize(STAR_RADIUS*2);
-  glBegin(GL_POINTS);
-  glVertex3f(0,0,0);
-  glEnd();
-  glDisable(GL_POINT_SPRITE);
-  glEnable(GL_LIGHTING);
+  draw_star();
 
   // Set up lighting for the star
   float star_pos[4] = {0.0, 0.0, 0.0, 1.0};
@@ -182,48 +382,122 @@ void Background::draw_objects() {
 
   // Draw distant objects
   glEnable(GL_RESCALE_NORMAL);
-  unsigned int seed_offset = RANDOM_STUFF_MASTER_SEED;
-  BOOST_FOREACH(const RandomStuffDensityRange& r, density_ranges) {
-    boost::binomial_distribution<unsigned int, float> count_dist(r.total_count, 1.0/r.segments);
-    boost::variate_generator<boost::taus88&, boost::binomial_distribution<unsigned int, float> > count_die(_random_gen, count_dist);
-
-    boost::uniform_real<float> radius_dist(r.rad_min, r.rad_max);
-    boost::variate_generator<boost::taus88&, boost::uniform_real<float> > radius_die(_random_gen, radius_dist);
+  if (_bubble_list == 0) {
+    compile_bubble_list();
+  }
+  glCallList(_bubble_list);
+  glDisable(GL_RESCALE_NORMAL);
+}
 
-    boost::uniform_real<float> pos_dist(0.0, 1.0/r.segments);
-    boost::variate_generator<boost::taus88&, boost::uniform_real<float> > pos_die(_random_gen, pos_dist);
+void Background::draw_star() {
+  // Draw this system's star, as a quad of its own size facing the camera
+  Vector right = _view_fwd.cross_prod(_view_up).to_length(STAR_RADIUS);
+  Vector up = right.cross_prod(_view_fwd).to_length(STAR_RADIUS);
+  float star_verts[12] = {
+    -right.x + up.x, -right.y + up.y, -right.z + up.z,
+    -right.x - up.x, -right.y - up.y, -right.z - up.z,
+    right.x - up.x, right.y - up.y, right.z - up.z,
+    right.x + up.x, right.y + up.y, right.z + up.z
+  };
+  const static float star_uv[8] = {
+    0.0, 0.0,
+    0.0, 1.0,
+    1.0, 1.0,
+    1.0, 0.0
+  };
+  glDisable(GL_LIGHTING);
+  _star_tex->bind();
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_COLOR_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, star_verts);
+  glTexCoordPointer(2, GL_FLOAT, 0, star_uv);
+  glDrawArrays(GL_QUADS, 0, 4);
+  glPopClientAttrib();
+  glEnable(GL_LIGHTING);
+}
 
-    boost::normal_distribution<float> d_offset_dist(0, r.d_sigma);
-    boost::variate_generator<boost::taus88&, boost::normal_distribution<float> > d_offset_die(_random_gen, d_offset_dist);
+// The starbox as it was drawn before the cube map, one immediate mode quad per starmap image
+void draw_six_quad_starbox(const std::vector<boost::shared_ptr<GLOOTexture> >& faces) {
+  GLOOPushedMatrix pm;
+  
+  float modelview[16];
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+  modelview[12] = modelview[13] = modelview[14] = 0.0;
+  glLoadMatrixf(modelview);
+  
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  const float d = STARBOX_DIST;
+  for (unsigned int i = 0; i < 6; ++i) {
+    GLOOPushedMatrix face_pm;
+    const StarmapFace& sf = STARMAP_FACES[i];
+    if (sf.angle != 0) {
+      glRotatef(sf.angle, sf.axis_x, sf.axis_y, 0);
+    }
     
-    boost::normal_distribution<float> y_offset_dist(0, r.d_sigma);
-    boost::variate_generator<boost::taus88&, boost::normal_distribution<float> > y_offset_die(_random_gen, y_offset_dist);
+    faces[i]->bind();
+    glBegin(GL_QUADS);
+    glTexCoord2fv(STARMAP_UV + ((sf.uv_offset+0)%4)*2);
+    glVertex3f(-d, +d, +d);
+    glTexCoord2fv(STARMAP_UV + ((sf.uv_offset+1)%4)*2);
+    glVertex3f(+d, +d, +d);
+    glTexCoord2fv(STARMAP_UV + ((sf.uv_offset+2)%4)*2);
+    glVertex3f(+d, -d, +d);
+    glTexCoord2fv(STARMAP_UV + ((sf.uv_offset+3)%4)*2);
+    glVertex3f(-d, -d, +d);
+    glEnd();
+  }
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_LIGHTING);
+}
 
-    static const boost::uniform_real<float> angle_dist(0, 1);
-    static const boost::variate_generator<boost::taus88&, boost::uniform_real<float> > angle_die(_random_gen, angle_dist);
-    
-    for (unsigned int s = 0; s < r.segments; ++s) {
-      _random_gen.seed((seed_offset + s)*RANDOM_STUFF_SEED_COEF);
-      unsigned int count = count_die();
-      float start_angle = s*(1.0/r.segments);
-      for (unsigned int i = 0; i < count; ++i) {
-        GLOOPushedMatrix pm;
-        float pos_angle = rev2rad(start_angle + pos_die());
-        float d = STAR_DIST + d_offset_die();
-        glTranslatef(d*std::sin(pos_angle), y_offset_die(), d*std::cos(pos_angle));
-        float scale = radius_die();
-        glScalef(scale, scale, scale);
-        _distant_bubble->draw();
+// The star as it was drawn before, as a point sprite
+void draw_point_sprite_star(const boost::shared_ptr<GLOOTexture>& tex) {
+  glDisable(GL_LIGHTING);
+  glEnable(GL_POINT_SPRITE);
+  tex->bind();
+  glPointSize(STAR_RADIUS*2);
+  glBegin(GL_POINTS);
+  glVertex3f(0, 0, 0);
+  glEnd();
+  glDisable(GL_POINT_SPRITE);
+  glEnable(GL_LIGHTING);
+}
+
+void Background::benchmark_draws() {
+  std::vector<boost::shared_ptr<GLOOTexture> > faces;
+  for (unsigned int i = 0; i < 6; ++i) {
+    faces.push_back(GLOOTexture::load((boost::format("starmap-%u.png") % (i + 1)).str()));
+  }
+  
+  // Each run ends with glFinish, so the times include the GL work the calls queued up and not only making them
+  double ms[4];
+  for (unsigned int run = 0; run < 4; ++run) {
+    glFinish();
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    for (unsigned int n = 0; n < BENCHMARK_DRAWS; ++n) {
+      switch (run) {
+        case 0: draw_starbox(); break;
+        case 1: draw_six_quad_starbox(faces); break;
+        case 2: draw_star(); break;
+        default: draw_point_sprite_star(_star_tex); break;
       }
     }
-    seed_offset += r.segments;
+    glFinish();
+    ms[run] = ms_since(start)/BENCHMARK_DRAWS;
   }
-  glDisable(GL_RESCALE_NORMAL);
+  
+  Debug::status_msg((boost::format("Starbox: %.4f ms per draw as a cube map, %.4f ms as six quads") % ms[0] % ms[1]).str());
+  Debug::status_msg((boost::format("Star: %.4f ms per draw as a quad, %.4f ms as a point sprite") % ms[2] % ms[3]).str());
 }
 
 Vector Background::to_center_from_game_origin() {
   if (!_sky) {
     throw GameException("Unable to locate game origin, no SkySettings available");
   }
-  return _sky_offset;
+  // The sky offset is relative to the area origin, which the simulation origin may have moved away from
+  return _sky_offset - Sim::get_origin_offset();
 }
@@ -30,6 +30,7 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include "autoxsd/orepkgdesc.h"
 #include "geometry.h"
 
+class GLOOTexture;
 class MeshAnimation;
 
 class Background {
@@ -37,6 +38,22 @@ class Background {
     boost::shared_ptr<ORE1::SkySettingsType> _sky;
     boost::taus88 _random_gen;
     Vector _sky_offset;
+    
+    boost::shared_ptr<GLOOTexture> _star_tex;
+    boost::shared_ptr<MeshAnimation> _distant_bubble;
+    
+    // The six starmap images, resampled into a cube map when the Background is created
+    unsigned int _sky_cubemap; // GL texture name
+    
+    // Camera orientation for the current frame, used to draw things that should only rotate with the view
+    Vector _view_fwd, _view_up;
+    
+    // The distant bubble field is the same every time, so it's generated once and then drawn from a display list
+    struct BubbleInstance {
+      float x, y, z, scale;
+    };
+    std::vector<BubbleInstance> _bubbles;
+    unsigned int _bubble_list; // GL display list name, or 0 if not compiled yet
 
     struct RandomStuffDensityRange {
       unsigned int segments;
@@ -53,16 +70,28 @@ class Background {
     
     static std::vector<RandomStuffDensityRange> density_ranges;
 
+    void build_sky_cubemap();
+    void generate_bubbles();
+    void compile_bubble_list();
+    void draw_star();
+  
   public:
     static void init();
     static void deinit();
     
     Background();
+    ~Background();
 
     void set_sky(const ORE1::SkySettingsType& sky);
     
+    // Called by ModeStack whenever a camera is set up
+    void set_view(const Vector& fwd, const Vector& up);
+    
     void draw_starbox();
     void draw_objects();
+    
+    // Times drawing the starbox and star against the six quads and point sprite they replaced, and logs the results
+    void benchmark_draws();
     Vector to_center_from_game_origin();
 };
 
@@ -22,11 +22,77 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 
 //#include <GL/glew.h>
 
+#include <boost/scoped_ptr.hpp>
+#include <cmath>
+#include <vector>
+
 #include "bubble.h"
 #include "autoxsd/orepkgdesc.h"
+#include "render_queue.h"
 
 AutoRegistration<GameObjFactorySpec, BubbleGameObj> bubble_gameobj_reg("Bubble");
 
+// Tessellations of the shared unit sphere, from coarsest to finest, and the on-screen radius in pixels up to which each is used
+const unsigned int SPHERE_LOD_COUNT = 3;
+const unsigned int SPHERE_LOD_DIVISIONS[SPHERE_LOD_COUNT] = { 8, 16, 32 };
+const float SPHERE_LOD_MAX_PIXELS[SPHERE_LOD_COUNT - 1] = { 32, 128 };
+
+// A unit sphere as indexed triangles, wound to face inwards like gluSphere with GLU_INSIDE
+struct SphereMesh {
+  std::vector<float> verts;
+  std::vector<GLushort> indices;
+  
+  SphereMesh(unsigned int divs) {
+    for (unsigned int i = 0; i <= divs; ++i) {
+      float polar = M_PI*i/divs;
+      for (unsigned int j = 0; j <= divs; ++j) {
+        float azimuth = 2*M_PI*j/divs;
+        verts.push_back(std::sin(polar)*std::cos(azimuth));
+        verts.push_back(std::sin(polar)*std::sin(azimuth));
+        verts.push_back(std::cos(polar));
+      }
+    }
+    
+    for (unsigned int i = 0; i < divs; ++i) {
+      for (unsigned int j = 0; j < divs; ++j) {
+        GLushort a = i*(divs + 1) + j, b = a + divs + 1, c = b + 1, d = a + 1;
+        GLushort tris[6] = { a, c, b, a, d, c };
+        indices.insert(indices.end(), tris, tris + 6);
+      }
+    }
+  }
+  
+  void draw() const {
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, &verts[0]);
+    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, &indices[0]);
+    glPopClientAttrib();
+  }
+};
+
+// Built on first use, and shared by every bubble
+const SphereMesh& get_sphere_mesh(unsigned int lod) {
+  static boost::scoped_ptr<SphereMesh> meshes[SPHERE_LOD_COUNT];
+  if (!meshes[lod]) {
+    meshes[lod].reset(new SphereMesh(SPHERE_LOD_DIVISIONS[lod]));
+  }
+  return *meshes[lod];
+}
+
+unsigned int BubbleGameObj::choose_sphere_lod() const {
+  float pixels = RenderQueue::get_screen_radius(get_pos(), _radius);
+  for (unsigned int lod = 0; lod < SPHERE_LOD_COUNT - 1; ++lod) {
+    if (pixels <= SPHERE_LOD_MAX_PIXELS[lod]) {
+      return lod;
+    }
+  }
+  return SPHERE_LOD_COUNT - 1;
+}
+
 void BubbleGameObj::near_draw_impl() {
   // Draw the bubble's inside and/or outside surface
   
@@ -36,18 +102,26 @@ void BubbleGameObj::near_draw_impl() {
   // TODO Draw the outside
   
   // Inside
-  gluQuadricOrientation(_quadric, GLU_INSIDE);
   glColor4f(0.7, 0.7, 1.0, 0.8);
-  gluSphere(_quadric, _radius, 16, 16);
+  {
+    GLOOPushedMatrix pm;
+    glScalef(_radius, _radius, _radius);
+    get_sphere_mesh(choose_sphere_lod()).draw();
+  }
   glColor4f(1.0, 1.0, 1.0, 1.0);
   
   glEnable(GL_TEXTURE_2D);
   glEnable(GL_LIGHTING);
 }
 
+RenderState BubbleGameObj::get_render_state() const {
+  // Bubbles are all drawn the same way, and are see-through
+  static const unsigned int state_id = RenderQueue::get_state_id("bubble");
+  return RenderState(state_id, 0, true);
+}
+
 BubbleGameObj::BubbleGameObj(const ORE1::ObjType& obj) :
   GameObj(obj),
-  _quadric(gluNewQuadric()),
   _radius(static_cast<const ORE1::BubbleObjType&>(obj).radius())
 {
 }
@@ -28,14 +28,19 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 
 class BubbleGameObj : public GameObj {
   private:
-    GLUquadric* _quadric;
     float _radius;
-
+    
+    // Picks the shared sphere tessellation to use from how big the bubble is on screen
+    unsigned int choose_sphere_lod() const;
+  
   protected:
     void near_draw_impl();
-
+  
   public:
     BubbleGameObj(const ORE1::ObjType& obj);
+    
+    float get_bounding_radius() const { return _radius; }
+    RenderState get_render_state() const;
 };
 
 #endif
@@ -34,6 +34,9 @@ const unsigned int MIN_TICKS_PER_FRAME = 1000/MAX_FPS;
 const float GAMEPLAY_CLIP_DIST = 50000;
 const float SKY_CLIP_DIST = 2e12;
 
+// Near clipping distance of the projection used for background objects
+const float SKY_NEAR_DIST = 1000;
+
 // Field-of-view in degrees
 const float FOV = 45;
 
@@ -72,7 +72,7 @@ class ControlSettingsMenuMode : public Mode {
     void load_widget_labels();
 
     static const boost::array<AxisActionDesc, 6> AXIS_BOUND_ACTION_NAMES;
-    static const boost::array<ButtonActionDesc, 6> BUTTON_BOUND_ACTION_NAMES;
+    static const boost::array<ButtonActionDesc, 7> BUTTON_BOUND_ACTION_NAMES;
 
   public:
     ControlSettingsMenuMode(bool at_main_menu);
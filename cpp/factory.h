@@ -37,6 +37,9 @@ template<class BaseType, class SourceType> class FactorySpecBase {
     typedef SourceType source_type;
     
     virtual std::string extract_name(const SourceType& source) { return typeid(source).name(); }
+    
+    // Called on everything the factory creates, with the name it was created under
+    virtual void created(const std::string& name __attribute__ ((unused)), BaseType& obj __attribute__ ((unused))) {}
 };
 
 template<class FactorySpec> class Generator {
@@ -82,7 +85,9 @@ template<class FactorySpec> class Factory {
       }
       
       if (i != _generator_map.end()) {
-        return i->second->create(source);
+        boost::shared_ptr<typename FactorySpec::base_type> obj = i->second->create(source);
+        s.created(name, *obj);
+        return obj;
       } else {
         throw GameException("No implementation for " + name + " under FactorySpec " + typeid(FactorySpec).name());
       }
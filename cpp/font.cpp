@@ -28,24 +28,66 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 
 #include "except.h"
 #include "font.h"
+#include "geometry.h"
+#include "gui.h"
 
 
 #include "autoxsd/fontdesc.h"
 #include "autoxsd/fontdesc-pimpl.h"
 
-const unsigned int FONT_MAX_STR_LENGTH = 512;
+// How many string layouts are kept before the cache is emptied and starts over
+// This is comfortably more than the number of different strings on the screen at once.
+const unsigned int FONT_LAYOUT_CACHE_SIZE = 512;
 
-std::pair<unsigned char, short> Font::get_glyph_height_and_y_offset(float height) {
-  std::pair<unsigned char, short> r(0, 0);
-  for (std::map<unsigned char, std::map<char, std::pair<short, unsigned char> > >::iterator i = _glyph_data.begin(); i != _glyph_data.end(); ++i) {
-    if (i->first > height) {
-      break;
+// GL calls each string took when it was drawn on its own, with its own matrix, texture environment and client state
+const unsigned int FONT_UNBATCHED_GL_CALLS = 20;
+
+short Font::get_size_index(float height) const {
+  if (height < 0) {
+    return -1;
+  }
+  return _size_for_height[height >= 255 ? 255 : static_cast<unsigned int>(height)];
+}
+
+const Font::Layout& Font::get_layout(short size_idx, const std::string& str) {
+  std::pair<short, std::string> key(size_idx, str);
+  LayoutCache::iterator i = _layouts.find(key);
+  if (i != _layouts.end()) {
+    return i->second;
+  }
+  
+  // HUD text that changes every frame (like the speed display) would otherwise fill the cache without bound
+  if (_layouts.size() >= FONT_LAYOUT_CACHE_SIZE) {
+    _layouts.clear();
+  }
+  Layout& layout = _layouts[key];
+  layout.width = 0.0;
+  if (size_idx < 0) {
+    return layout;
+  }
+  
+  const GlyphSize& gs = _sizes[size_idx];
+  Size t = _tex->get_size();
+  float top_v = float(gs.y_offset)/t.y;
+  float bottom_v = float(gs.y_offset + gs.height)/t.y;
+  float& x = layout.width;
+  for (std::string::const_iterator c = str.begin(); c != str.end(); ++c) {
+    const Glyph& g = gs.glyphs[static_cast<unsigned char>(*c)];
+    if (!g.present) {
+      continue;
+    }
+    if (g.offset >= 0) {
+      float left_u = float(g.offset)/t.x;
+      float right_u = float(g.offset + g.width)/t.x;
+      float h = gs.height;
+      float quad[8] = { x, h, x + g.width, h, x + g.width, 0.0, x, 0.0 }; // 0 1, 1 1, 1 0, 0 0
+      float uv_quad[8] = { left_u, bottom_v, right_u, bottom_v, right_u, top_v, left_u, top_v };
+      layout.points.insert(layout.points.end(), quad, quad + 8);
+      layout.uv_points.insert(layout.uv_points.end(), uv_quad, uv_quad + 8);
     }
-    r.first = i->first;
-    r.second += i->first;
+    x += g.width + 1;
   }
-  r.second -= r.first;
-  return r;
+  return layout;
 }
 
 Font::Font(const unsigned char* img_data, unsigned int img_data_len, const char* font_desc_str) {
@@ -57,15 +99,40 @@ Font::Font(const unsigned char* img_data, unsigned int img_data_len, const char*
     fontdesc_p.pre();
     doc_p.parse(font_desc_stream);
     std::auto_ptr<ORFontDesc::FontDescType> font_desc(fontdesc_p.post());
-  
+    
+    // Collect the sizes in height order first, since that is the order their strips are stacked in the texture
+    std::map<unsigned char, const ORFontDesc::SizeDescType*> size_descs;
     for (ORFontDesc::FontDescType::sizedesc_const_iterator sd = font_desc->sizedesc().begin(); sd != font_desc->sizedesc().end(); ++sd) {
-      std::map<char, std::pair<short, unsigned char> >& glyphmap = _glyph_data[sd->height()];
-      for (ORFontDesc::SizeDescType::glyph_const_iterator gd = sd->glyph().begin(); gd != sd->glyph().end(); ++gd) {
-        glyphmap[gd->character()[0]] = std::pair<short, unsigned char>(gd->offset(), gd->width());
+      size_descs[sd->height()] = &(*sd);
+    }
+    
+    short y_offset = 0;
+    _sizes.resize(size_descs.size());
+    std::vector<GlyphSize>::iterator gs = _sizes.begin();
+    for (std::map<unsigned char, const ORFontDesc::SizeDescType*>::iterator i = size_descs.begin(); i != size_descs.end(); ++i, ++gs) {
+      gs->height = i->first;
+      gs->y_offset = y_offset;
+      y_offset += i->first;
+      for (ORFontDesc::SizeDescType::glyph_const_iterator gd = i->second->glyph().begin(); gd != i->second->glyph().end(); ++gd) {
+        Glyph& g = gs->glyphs[static_cast<unsigned char>(gd->character()[0])];
+        g.present = true;
+        g.offset = gd->offset();
+        g.width = gd->width();
       }
-      glyphmap[' '] = std::pair<short, unsigned char>(-1, glyphmap['h'].second/2); // Make spaces half as wide as the letter 'h'
+      Glyph& space = gs->glyphs[static_cast<unsigned char>(' ')];
+      space.present = true;
+      space.offset = -1;
+      space.width = gs->glyphs[static_cast<unsigned char>('h')].width/2; // Make spaces half as wide as the letter 'h'
     }
-
+    
+    short idx = -1;
+    for (unsigned int h = 0; h < 256; ++h) {
+      while (idx + 1 < short(_sizes.size()) and _sizes[idx + 1].height <= h) {
+        ++idx;
+      }
+      _size_for_height[h] = idx;
+    }
+    
     SDL_RWops* img_rw_ops(SDL_RWFromConstMem(img_data, img_data_len));
     _tex.reset(new GLOOTexture(img_rw_ops, true));
     SDL_FreeRW(img_rw_ops);
@@ -77,81 +144,39 @@ Font::Font(const unsigned char* img_data, unsigned int img_data_len, const char*
 }
 
 float Font::get_width(float height, const std::string& str) {
-  unsigned char h = get_glyph_height_and_y_offset(height).first;
-  std::map<char, std::pair<short, unsigned char> >& glyphmap = _glyph_data[h];
-
-  float width = 0.0;
-  unsigned int glyphs = 0;
-  for (std::string::const_iterator c = str.begin(); c != str.end(); ++c) {
-    std::map<char, std::pair<short, unsigned char> >::iterator g = glyphmap.find(*c);
-    if (g != glyphmap.end()) {
-      width += g->second.second + 1;
-      if (g->second.first >= 0) {
-        ++glyphs;
-        if (glyphs == FONT_MAX_STR_LENGTH) {
-          break;
-        }
-      }
-    }
-  }
-  return width;
+  return get_layout(get_size_index(height), str).width;
 }
 
 void Font::draw(const Point& upper_left, float height, const std::string& str) {
-  std::pair<unsigned char, short> hy = get_glyph_height_and_y_offset(height);
-  std::map<char, std::pair<short, unsigned char> >& glyphmap = _glyph_data[hy.first];
-
-  static float points[FONT_MAX_STR_LENGTH*8];
-  static float uv_points[FONT_MAX_STR_LENGTH*8];
-  float x = 0.0;
-  Size t = _tex->get_size();
-  unsigned int glyphs = 0;
-  for (std::string::const_iterator c = str.begin(); c != str.end(); ++c) {
-    std::map<char, std::pair<short, unsigned char> >::iterator g = glyphmap.find(*c);
-    if (g != glyphmap.end()) {
-      if (g->second.first >= 0) {
-        // 0 1
-        points[glyphs*8 + 0] = x; points[glyphs*8 + 1] = hy.first;
-        uv_points[glyphs*8 + 0] = float(g->second.first)/t.x; uv_points[glyphs*8 + 1] = float(hy.second + hy.first)/t.y;
-
-        // 1 1
-        points[glyphs*8 + 2] = x + g->second.second; points[glyphs*8 + 3] = hy.first;
-        uv_points[glyphs*8 + 2] = float(g->second.first + g->second.second)/t.x; uv_points[glyphs*8 + 3] = float(hy.second + hy.first)/t.y;
-
-        // 1 0
-        points[glyphs*8 + 4] = x + g->second.second; points[glyphs*8 + 5] = 0.0;
-        uv_points[glyphs*8 + 4] = float(g->second.first + g->second.second)/t.x; uv_points[glyphs*8 + 5] = float(hy.second)/t.y;
-
-        // 0 0
-        points[glyphs*8 + 6] = x; points[glyphs*8 + 7] = 0.0;
-        uv_points[glyphs*8 + 6] = float(g->second.first)/t.x; uv_points[glyphs*8 + 7] = float(hy.second)/t.y;
-        
-        ++glyphs;
-        if (glyphs == FONT_MAX_STR_LENGTH) {
-          break;
-        }
-      }
-      x += g->second.second + 1;
+  short size_idx = get_size_index(height);
+  const Layout& layout = get_layout(size_idx, str);
+  if (layout.points.empty()) {
+    return;
+  }
+  unsigned char glyph_height = _sizes[size_idx].height;
+  
+  // Text goes into the GUI batch, in the color that's current now; the 2D drawing mode has no transform of its own
+  float ox = std::floor(upper_left.x + 0.5);
+  float oy = upper_left.y + std::floor((height - glyph_height)/2 + height*0.12 + 0.5);
+  float color[4];
+  glGetFloatv(GL_CURRENT_COLOR, color);
+  
+  static std::vector<GUI::BatchVertex> verts;
+  verts.resize(layout.points.size()/8*6);
+  static const unsigned int quad_corners[6] = { 0, 1, 2, 0, 2, 3 };
+  for (unsigned int q = 0; q < layout.points.size()/8; ++q) {
+    for (unsigned int i = 0; i < 6; ++i) {
+      GUI::BatchVertex& v = verts[q*6 + i];
+      unsigned int c = q*8 + quad_corners[i]*2;
+      v.x = ox + layout.points[c];
+      v.y = oy + layout.points[c + 1];
+      v.u = layout.uv_points[c];
+      v.v = layout.uv_points[c + 1];
+      v.r = color[0];
+      v.g = color[1];
+      v.b = color[2];
+      v.a = color[3];
     }
   }
-
-  GLOOPushedMatrix pm;
-  _tex->bind();
-  glTranslatef(std::floor(upper_left.x + 0.5), upper_left.y + std::floor((height - hy.first)/2 + height*0.12 + 0.5), 0);
-  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
-  glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_REPLACE);
-  glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_RGB, GL_PRIMARY_COLOR);
-  glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR);
-  glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_REPLACE);
-  glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_ALPHA, GL_TEXTURE);
-  glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-  glDisableClientState(GL_NORMAL_ARRAY);
-  glVertexPointer(2, GL_FLOAT, 0, points);
-  glTexCoordPointer(2, GL_FLOAT, 0, uv_points);
-  glDrawArrays(GL_QUADS, 0, glyphs*4);
-  glPopClientAttrib();
-  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  GUI::Batch::add(GUI::Batch::TEXT, _tex.get(), &verts[0], verts.size(), FONT_UNBATCHED_GL_CALLS);
 }
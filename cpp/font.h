@@ -24,15 +24,50 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 
 #include <boost/shared_ptr.hpp>
 #include <map>
+#include <string>
+#include <utility>
+#include <vector>
 
+class GLOOTexture;
 class Point;
 
 class Font {
   private:
-    // Key is max glyph height, value maps input char to offset and width. Offset is -1 for no character (i.e. space)
-    std::map<unsigned char, std::map<char, std::pair<short, unsigned char> > > _glyph_data;
-
-    std::pair<unsigned char, short> get_glyph_height_and_y_offset(float height);
+    struct Glyph {
+      bool present;
+      short offset; // Offset into the texture, or -1 for no image (i.e. space)
+      unsigned char width;
+      Glyph() : present(false), offset(-1), width(0) {}
+    };
+    
+    // Each size's glyphs are in a strip of the texture, with the strips stacked smallest first
+    struct GlyphSize {
+      unsigned char height;
+      short y_offset;
+      Glyph glyphs[256];
+    };
+    
+    // Quad corners and texture coordinates for a string, relative to its upper left
+    struct Layout {
+      std::vector<float> points;
+      std::vector<float> uv_points;
+      float width;
+    };
+    
+    boost::shared_ptr<GLOOTexture> _tex;
+    
+    // Sorted by height, smallest first
+    std::vector<GlyphSize> _sizes;
+    
+    // For each whole-number height, the index in _sizes of the largest size that fits within it, or -1 if none do
+    short _size_for_height[256];
+    
+    // Layouts of recently drawn or measured strings, keyed by size index and string
+    typedef std::map<std::pair<short, std::string>, Layout> LayoutCache;
+    LayoutCache _layouts;
+    
+    short get_size_index(float height) const;
+    const Layout& get_layout(short size_idx, const std::string& str);
   
   public:
     Font(const unsigned char* img_data, unsigned int img_data_len, const char* font_desc);
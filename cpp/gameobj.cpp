@@ -25,7 +25,9 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
+#include <algorithm>
 #include <cctype>
+#include <limits>
 #include <vector>
 
 #include "autoxsd/orepkgdesc.h"
@@ -35,16 +37,68 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include "gameobj.h"
 #include "geometry.h"
 #include "globals.h"
+#include "snapshot.h"
 
 
 // Default coefficients for linear and angular damping on new GameObjs
 const float DEFAULT_VEL_DAMP_COEF = 0.15;
 const float DEFAULT_ANG_DAMP_COEF = 0.15;
 
+// Default distances at which GameObjs drop to half, quarter, and eighth step rate, and then are frozen
+const float DEFAULT_SIM_LOD_DIST[SIM_LOD_FROZEN] = { 500, 1000, 2000, 4000 };
+
+// An object must get this fraction further than a band's distance before it drops into that band
+// Otherwise objects sitting right at the boundary would flip between levels every step.
+const float SIM_LOD_HYSTERESIS = 0.1;
+
+SimLodPolicy::SimLodPolicy() {
+  std::copy(DEFAULT_SIM_LOD_DIST, DEFAULT_SIM_LOD_DIST + SIM_LOD_FROZEN, band_dist);
+}
+
+SimLodPolicy::SimLodPolicy(float half_rate_dist, float quarter_rate_dist, float eighth_rate_dist, float freeze_dist) {
+  band_dist[0] = half_rate_dist;
+  band_dist[1] = quarter_rate_dist;
+  band_dist[2] = eighth_rate_dist;
+  band_dist[3] = freeze_dist;
+}
+
+SimLodPolicy SimLodPolicy::full_rate() {
+  float inf = std::numeric_limits<float>::infinity();
+  return SimLodPolicy(inf, inf, inf, inf);
+}
+
+// Created on first use, for the same reason as in get_factory
+typedef std::map<std::string, SimLodPolicy> SimLodPolicyMap;
+SimLodPolicyMap& get_sim_lod_policies() {
+  static SimLodPolicyMap policies;
+  return policies;
+}
+
+SimLodRegistration::SimLodRegistration(const std::string& name, const SimLodPolicy& policy) {
+  if (!get_sim_lod_policies().insert(SimLodPolicyMap::value_type(name, policy)).second) {
+    throw GameException("Attempted to register over existing simulation LOD policy for " + name);
+  }
+}
+
+const SimLodPolicy& SimLodRegistration::get(const std::string& name) {
+  static const SimLodPolicy default_policy;
+  const SimLodPolicyMap& policies = get_sim_lod_policies();
+  SimLodPolicyMap::const_iterator i = policies.find(name);
+  if (i == policies.end()) {
+    i = policies.find("");
+  }
+  return i == policies.end() ? default_policy : i->second;
+}
+
 GameObj::GameObj(const Point& pos, std::auto_ptr<OdeEntity> entity) :
   _pos(pos),
   _vel(Vector()),
-  _entity(entity)
+  _entity(entity),
+  _lod_policy(&SimLodRegistration::get("")),
+  _lod_level(0),
+  _lod_pending_steps(0),
+  _registry_list(0),
+  _registry_index(0)
 {
   // Identity matrix, no rotation to start with
   _rot[0] = 1; _rot[1] = 0; _rot[2] = 0;
@@ -58,11 +112,17 @@ GameObj::GameObj(const Point& pos, std::auto_ptr<OdeEntity> entity) :
 GameObj::GameObj(const ORE1::ObjType& obj, std::auto_ptr<OdeEntity> entity) :
   _pos(Point(obj.pos()[0], obj.pos()[1], obj.pos()[2])),
   _vel(Vector()),
-  _entity(entity)
+  _entity(entity),
+  _lod_policy(&SimLodRegistration::get(GameObjFactorySpec().extract_name(obj))),
+  _lod_level(0),
+  _lod_pending_steps(0),
+  _registry_list(0),
+  _registry_index(0)
 {
   std::copy(obj.rot().begin(), obj.rot().end(), _rot.begin());
   
   common_setup();
+  _entity->set_material(SurfaceMaterial(obj.friction(), obj.bounce()));
   
   if (obj.implName() != "") {
     LSMap::const_iterator scene_iter = Globals::libscenes.find("LIB" + obj.implName());
@@ -75,6 +135,10 @@ GameObj::GameObj(const ORE1::ObjType& obj, std::auto_ptr<OdeEntity> entity) :
   }
 }
 
+GameObj::~GameObj() {
+  GameObjRegistry::remove(this);
+}
+
 void GameObj::common_setup() {
   _entity->set_pos(_pos);
   _entity->set_rot(_rot);
@@ -133,15 +197,15 @@ void GameObj::draw(bool near) {
   }
 }
 
-void GameObj::step() {
-  const dReal* p;
-  dBodyID b = 0;
-  if (_entity->has_id()) {
-    b = _entity->get_id();
-  }
-  
+void GameObj::rebase(const Vector& shift) {
+  _pos -= shift;
+  _entity->translate(-shift);
+}
+
+void GameObj::sync_from_body() {
   // Load position, rotation, and velocity from ODE if there are dynamics for this GameObj
-  if (b != 0) {
+  if (_entity->has_id()) {
+    dBodyID b = _entity->get_id();
     const dReal* p;
     
     p = dBodyGetPosition(b);
@@ -161,10 +225,70 @@ void GameObj::step() {
     _vel.y = p[1];
     _vel.z = p[2];
   }
+}
+
+unsigned int GameObj::choose_lod_level() const {
+  if (!Sim::has_lod_focus()) {
+    return 0;
+  }
+  
+  float dist = _pos.dist_to(Sim::get_lod_focus());
+  for (unsigned int level = SIM_LOD_FROZEN; level > 0; --level) {
+    float band_dist = _lod_policy->band_dist[level - 1];
+    if (level > _lod_level) {
+      band_dist *= 1 + SIM_LOD_HYSTERESIS;
+    }
+    if (dist > band_dist) {
+      return level;
+    }
+  }
+  return 0;
+}
+
+void GameObj::set_lod_level(unsigned int level) {
+  if (level == _lod_level) {
+    return;
+  }
+  
+  if (_lod_level == SIM_LOD_FROZEN) {
+    // Nothing happened while frozen, so there's no time to catch up on
+    _lod_pending_steps = 0;
+    if (_entity->has_id()) {
+      dBodyEnable(_entity->get_id());
+    }
+  }
+  _lod_level = level;
+}
+
+void GameObj::step() {
+  const dReal* p;
+  dBodyID b = 0;
+  if (_entity->has_id()) {
+    b = _entity->get_id();
+  }
+  
+  // Positions are always reloaded, so that objects at reduced rates still move smoothly when drawn
+  sync_from_body();
+  set_lod_level(choose_lod_level());
+  
+  if (_lod_level == SIM_LOD_FROZEN) {
+    // Checked every step rather than on the transition, since contact joints and rewinding can re-enable the body
+    if (b != 0 and dBodyIsEnabled(b)) {
+      dBodyDisable(b);
+    }
+    return;
+  }
+  
+  // When an object is promoted to a finer level, this runs on the very next step with everything it missed
+  ++_lod_pending_steps;
+  if (_lod_pending_steps < (1u << _lod_level)) {
+    return;
+  }
   
   step_impl();
   
-  // Apply damping
+  // Apply damping, scaled up to make up for the steps that were skipped
+  // Forces only last for one ODE step, so the total impulse comes out about the same as damping on every step.
   if (b != 0) {
     int i;
     dReal x, y, z;
@@ -176,7 +300,7 @@ void GameObj::step() {
     z = *p;
     dBodyVectorFromWorld(b, x, y, z, v);
     for (i = 0; i < 3; ++i) {
-      v[i] *= -_vel_damp_coef[i]/MAX_FPS;
+      v[i] *= -_vel_damp_coef[i]*_lod_pending_steps/MAX_FPS;
     }
     dBodyAddRelForce(b, v[0], v[1], v[2]);
     
@@ -186,10 +310,82 @@ void GameObj::step() {
     z = *p;
     dBodyVectorFromWorld(b, x, y, z, v);
     for (i = 0; i < 3; ++i) {
-      v[i] *= -_ang_damp_coef[i]/MAX_FPS;
+      v[i] *= -_ang_damp_coef[i]*_lod_pending_steps/MAX_FPS;
     }
     dBodyAddRelTorque(b, v[0], v[1], v[2]);
   }
+  
+  _lod_pending_steps = 0;
+}
+
+// ODE vectors are stored as 4 dReals for alignment, but only the first 3 matter
+void save_ode_vector(SnapshotBuffer& buf, const dReal* v) {
+  buf.write(v[0]); buf.write(v[1]); buf.write(v[2]);
+}
+
+void restore_ode_vector(SnapshotBuffer& buf, dVector3 v) {
+  buf.read(v[0]); buf.read(v[1]); buf.read(v[2]);
+}
+
+void GameObj::save_state(SnapshotBuffer& buf) const {
+  buf.write(_pos);
+  buf.write(_rot);
+  buf.write(_vel);
+  buf.write(_lod_level);
+  buf.write(_lod_pending_steps);
+  
+  // The ODE state is saved directly at full precision, rather than relying on the float copies above
+  // Forces have to be included too, since damping and controls are applied at the end of each step
+  if (_entity->has_id()) {
+    dBodyID b = _entity->get_id();
+    save_ode_vector(buf, dBodyGetPosition(b));
+    const dReal* q = dBodyGetQuaternion(b);
+    buf.write(q[0]); buf.write(q[1]); buf.write(q[2]); buf.write(q[3]);
+    save_ode_vector(buf, dBodyGetLinearVel(b));
+    save_ode_vector(buf, dBodyGetAngularVel(b));
+    save_ode_vector(buf, dBodyGetForce(b));
+    save_ode_vector(buf, dBodyGetTorque(b));
+    buf.write((bool)dBodyIsEnabled(b));
+  }
+  
+  save_state_impl(buf);
+}
+
+void GameObj::restore_state(SnapshotBuffer& buf) {
+  buf.read(_pos);
+  buf.read(_rot);
+  buf.read(_vel);
+  buf.read(_lod_level);
+  buf.read(_lod_pending_steps);
+  
+  // Bodyless objects never move, so there's nothing to put back into ODE for them
+  if (_entity->has_id()) {
+    dBodyID b = _entity->get_id();
+    dVector3 v;
+    
+    restore_ode_vector(buf, v);
+    dBodySetPosition(b, v[0], v[1], v[2]);
+    dQuaternion q;
+    buf.read(q[0]); buf.read(q[1]); buf.read(q[2]); buf.read(q[3]);
+    dBodySetQuaternion(b, q);
+    restore_ode_vector(buf, v);
+    dBodySetLinearVel(b, v[0], v[1], v[2]);
+    restore_ode_vector(buf, v);
+    dBodySetAngularVel(b, v[0], v[1], v[2]);
+    restore_ode_vector(buf, v);
+    dBodySetForce(b, v[0], v[1], v[2]);
+    restore_ode_vector(buf, v);
+    dBodySetTorque(b, v[0], v[1], v[2]);
+    bool enabled;
+    buf.read(enabled);
+    if (enabled) {
+      dBodyEnable(b);
+    } else {
+      dBodyDisable(b);
+    }
+  }
+  
+  restore_state_impl(buf);
 }
 
 Point GameObj::get_rel_point_pos(const Point& p) const {
@@ -227,3 +423,42 @@ const ORE1::ObjType& GameObj::get_libscene_obj(const std::string& name) const {
 std::string GameObjFactorySpec::extract_name(const ORE1::ObjType& source) {
   return source.implName();
 }
+
+void GameObjFactorySpec::created(const std::string& name, GameObj& obj) {
+  GameObjRegistry::add(name, &obj);
+}
+
+int GameObjRegistry::_counters[GameObjRegistry::COUNTER_COUNT] = {};
+
+// Created on first use, for the same reason as in get_factory
+GameObjRegistry::TypeMap& GameObjRegistry::get_types() {
+  static TypeMap types;
+  return types;
+}
+
+const std::vector<GameObj*>& GameObjRegistry::get(const std::string& impl_name) {
+  static const std::vector<GameObj*> none;
+  TypeMap::const_iterator i = get_types().find(impl_name);
+  return i == get_types().end() ? none : i->second;
+}
+
+void GameObjRegistry::add(const std::string& impl_name, GameObj* obj) {
+  std::vector<GameObj*>& list = get_types()[impl_name];
+  obj->_registry_list = &list;
+  obj->_registry_index = list.size();
+  list.push_back(obj);
+}
+
+void GameObjRegistry::remove(GameObj* obj) {
+  if (obj->_registry_list == 0) {
+    return;
+  }
+  
+  // Move the last object into the removed one's place, so removal doesn't depend on how many there are
+  std::vector<GameObj*>& list = *(obj->_registry_list);
+  GameObj* last = list.back();
+  list[obj->_registry_index] = last;
+  last->_registry_index = obj->_registry_index;
+  list.pop_back();
+  obj->_registry_list = 0;
+}
@@ -32,17 +32,46 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "factory.h"
 #include "geometry.h"
+#include "render_queue.h"
 #include "sim.h"
 
 namespace ORE1 { class ObjType; }
+class GameObjRegistry;
+class SnapshotBuffer;
+
+// Simulation LOD levels run from full rate at 0 through stepping every 2nd, 4th, and 8th step, up to frozen
+const unsigned int SIM_LOD_FROZEN = 4;
+
+// Distances from the LOD focus at which a type of GameObj drops to each simulation LOD level
+struct SimLodPolicy {
+  // band_dist[n] is how far away the object must be to be at level n+1 or higher
+  float band_dist[SIM_LOD_FROZEN];
+  
+  SimLodPolicy();
+  SimLodPolicy(float half_rate_dist, float quarter_rate_dist, float eighth_rate_dist, float freeze_dist);
+  
+  // A policy under which objects are always stepped at full rate
+  static SimLodPolicy full_rate();
+};
+
+// Gives the GameObjs created under a factory name their own SimLodPolicy
+// Instances are meant to be static, next to the AutoRegistration for the same type; unregistered types use the default policy.
+class SimLodRegistration {
+  public:
+    SimLodRegistration(const std::string& name, const SimLodPolicy& policy);
+    
+    static const SimLodPolicy& get(const std::string& name);
+};
 
 class GameObj : boost::noncopyable {
   public:
     GameObj(const Point& pos, std::auto_ptr<OdeEntity> entity = Sim::gen_empty_body());
     GameObj(const ORE1::ObjType& obj, std::auto_ptr<OdeEntity> entity = Sim::gen_empty_body());
+    virtual ~GameObj();
     
     const Point& get_pos() const { return _pos; }
     void set_pos(const Point& pos);
@@ -53,11 +82,32 @@ class GameObj : boost::noncopyable {
     const Vector& get_vel() const { return _vel; }
     float get_speed() const { return _vel.mag(); }
     
+    bool has_body() const { return _entity->has_id(); }
+    
+    unsigned int get_sim_lod_level() const { return _lod_level; }
+    
+    // Radius around get_pos() which everything drawn by this object fits within, or negative if unknown
+    // Objects with an unknown radius are never culled, and are always drawn with the near projection.
+    virtual float get_bounding_radius() const { return -1; }
+    
+    // Used by RenderQueue to group this object with others that draw with the same GL state
+    virtual RenderState get_render_state() const { return RenderState(); }
+    
     std::string to_str() const;
     
     void draw(bool near);
     void step();
     
+    // Reloads the cached position, rotation, and velocity from the ODE body, if there is one
+    void sync_from_body();
+    
+    // Called by Sim when the simulation origin moves by shift
+    void rebase(const Vector& shift);
+    
+    // Saves or restores position, velocity, and pending forces, along with whatever subclasses add in *_state_impl
+    void save_state(SnapshotBuffer& buf) const;
+    void restore_state(SnapshotBuffer& buf);
+    
     Point get_rel_point_pos(const Point& p) const;
     Point get_pos_rel_point(const Point& p) const;
     Vector vector_to_world(const Vector& v) const;
@@ -66,14 +116,19 @@ class GameObj : boost::noncopyable {
   protected:
     OdeEntity& get_entity() { return *_entity; }
     const OdeEntity& get_entity() const { return *_entity; }
-
+    
     const ORE1::ObjType& get_libscene_obj(const std::string& name) const;
     
     virtual void near_draw_impl() {}
     virtual void far_draw_impl() { near_draw_impl(); }
     virtual void step_impl() {}
+    virtual void save_state_impl(SnapshotBuffer& buf __attribute__ ((unused))) const {}
+    virtual void restore_state_impl(SnapshotBuffer& buf __attribute__ ((unused))) {}
   
   private:
+    friend class GameObjRegistry;
+    friend class Rewind;
+    
     Point _pos;
     boost::array<float, 9> _rot; // 3x3 column-major
     Vector _vel;
@@ -87,13 +142,53 @@ class GameObj : boost::noncopyable {
     float _ang_damp_coef[3];
     
     std::auto_ptr<OdeEntity> _entity;
-
+    
+    // Simulation level of detail, and how many steps have gone by since step_impl and damping were last run
+    const SimLodPolicy* _lod_policy;
+    unsigned int _lod_level;
+    unsigned int _lod_pending_steps;
+    
+    // Where this object is in GameObjRegistry, if it was created by the factory
+    std::vector<GameObj*>* _registry_list;
+    unsigned int _registry_index;
+    
     void common_setup();
+    unsigned int choose_lod_level() const;
+    void set_lod_level(unsigned int level);
+};
+
+// Indexes GameObjs by the factory name they were created under, and keeps running totals for mission conditions
+// Objects are added as the factory creates them and remove themselves when destroyed, so lookups never have to scan gameobjs.
+class GameObjRegistry {
+  public:
+    enum Counter {
+      RINGS_PASSED, // TargetRings which have been passed through
+      COUNTER_COUNT
+    };
+    
+    // Every existing object created under the given name, in no particular order
+    static const std::vector<GameObj*>& get(const std::string& impl_name);
+    
+    // Counters are kept up to date by the objects they're about, including when those objects are destroyed
+    static int get_counter(Counter c) { return _counters[c]; }
+    static void adjust_counter(Counter c, int delta) { _counters[c] += delta; }
+  
+  private:
+    friend class GameObj;
+    friend class GameObjFactorySpec;
+    
+    typedef std::map<std::string, std::vector<GameObj*> > TypeMap;
+    static TypeMap& get_types();
+    static int _counters[COUNTER_COUNT];
+    
+    static void add(const std::string& impl_name, GameObj* obj);
+    static void remove(GameObj* obj);
 };
 
 class GameObjFactorySpec : public FactorySpecBase<GameObj, ORE1::ObjType> {
   public:
     std::string extract_name(const ORE1::ObjType& source);
+    void created(const std::string& name, GameObj& obj);
 };
 
 #endif
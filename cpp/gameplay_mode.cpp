@@ -21,12 +21,14 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 */
 
 //#include <GL/glew.h>
+#include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <cmath>
 
 #include "avatar.h"
 #include "background.h"
 #include "constants.h"
+#include "debug.h"
 #include "display.h"
 #include "except.h"
 #include "font.h"
@@ -36,8 +38,15 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include "geometry.h"
 #include "gui.h"
 #include "input.h"
+#include "performance.h"
+#include "recording.h"
+#include "render_queue.h"
+#include "rewind.h"
 #include "simple_menu_modes.h"
 #include "saving.h"
+#include "sim.h"
+#include "state_hash.h"
+#include "streaming.h"
 
 // Camera positioning relative to avatar's reference frame
 const Vector CAMERA_POS_OFFSET(0.0, 1.1, -7.0);
@@ -53,27 +62,71 @@ const float PHYS_DEBUG_BOX_COLL_WINDOW = MAX_FPS*2;
 
 const std::string SPEED_NUMFMT("%6.2f m/s");
 
-GameplayMode::GameplayMode() : _fsm(*Globals::current_mission, *this) {
-  // Locate the avatar object
-  for (GOMap::iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
-    GOMap::size_type idx = i->first.find("LIBAvatar");
-    if (idx == 0) {
-      _avatar_key = i->first;
-      break;
+// The camera's view volume, as a set of tests against bounding spheres
+// It matches the perspective set up by ModeStack, running from the camera out to the sky clip distance.
+class ViewFrustum {
+  private:
+    Point _pos;
+    Vector _fwd, _right, _up;
+    float _tan_v, _tan_h; // Tangents of the vertical and horizontal half-angles
+    float _cos_v, _cos_h;
+  
+  public:
+    ViewFrustum(const GLOOCamera& cam) :
+      _pos(cam.pos),
+      _fwd((cam.tgt - cam.pos).to_length(1.0)),
+      _tan_v(std::tan(deg2rad(FOV/2))),
+      _tan_h(_tan_v*Display::get_screen_ratio())
+    {
+      _right = _fwd.cross_prod(cam.up).to_length(1.0);
+      _up = _right.cross_prod(_fwd);
+      _cos_v = 1.0/std::sqrt(1.0 + _tan_v*_tan_v);
+      _cos_h = 1.0/std::sqrt(1.0 + _tan_h*_tan_h);
     }
-  }
   
-  if (_avatar_key.size() == 0) {
-    throw GameException(std::string("Unable to locate LIBAvatar GameObj in GameplayMode init!"));
+    // Returns true if any part of the sphere might be visible
+    bool sees(const Point& center, float radius) const {
+      Vector d = center - _pos;
+      float z = d.dot_prod(_fwd);
+      if (z < -radius or z - radius > SKY_CLIP_DIST) {
+        return false;
+      }
+      
+      // Distance outside each pair of side planes is (|offset| - z*tan)*cos
+      if ((std::fabs(d.dot_prod(_right)) - z*_tan_h)*_cos_h > radius) {
+        return false;
+      }
+      if ((std::fabs(d.dot_prod(_up)) - z*_tan_v)*_cos_v > radius) {
+        return false;
+      }
+      return true;
+    }
+};
+
+GameplayMode::GameplayMode() :
+  _fsm(*Globals::current_mission, *this),
+  _checkpoint_state(MISSION_STATE_NONE),
+  _checkpoint_pending(false)
+{
+  if (GameObjRegistry::get("Avatar").empty()) {
+    throw GameException(std::string("Unable to locate Avatar GameObj in GameplayMode init!"));
   }
+  
+  _start_snapshot.capture(_fsm);
+  Rewind::reset();
+  Recording::mission_started();
+}
+
+GameplayMode::~GameplayMode() {
+  Recording::mission_ended();
 }
 
 AvatarGameObj* GameplayMode::find_avatar() {
-  GOMap::iterator i = Globals::gameobjs.find(_avatar_key);
-  if (i == Globals::gameobjs.end()) {
-    throw GameException(std::string("GameplayMode: LIBAvatar GameObj named ") + _avatar_key + " has disappeared unexpectedly");
+  const std::vector<GameObj*>& avatars = GameObjRegistry::get("Avatar");
+  if (avatars.empty()) {
+    throw GameException(std::string("GameplayMode: Avatar GameObj has disappeared unexpectedly"));
   }
-  return static_cast<AvatarGameObj*>(&(*(i->second)));
+  return static_cast<AvatarGameObj*>(avatars[0]);
 }
 
 const AvatarGameObj* GameplayMode::find_avatar() const {
@@ -83,6 +136,12 @@ const AvatarGameObj* GameplayMode::find_avatar() const {
 bool GameplayMode::handle_input() {
   // There is no avatar control handling here because that's dealt with in avatar step instead
   // If it weren't handled in avatar step, control would be negatively affected by framerate drops
+  // Replayed input only advances inside simulation steps, so a recorded Pause can't be matched to the frame it was
+  // pressed on; opening the pause menu during a replay would also stop the simulation and the replay would never finish
+  if (Recording::is_replaying()) {
+    return true;
+  }
+  
   if (Input::get_button_ch(ORSave::ButtonBoundAction::Pause).matches_frame_events()) {
     Globals::mode_stack->next_frame_push_mode(boost::shared_ptr<Mode>(new PauseMenuMode()));
   }
@@ -97,20 +156,66 @@ const GLOOCamera* GameplayMode::get_camera(bool top __attribute__ ((unused))) {
   return &_camera;
 }
 
-void GameplayMode::draw_3d_far(bool top __attribute__ ((unused))) {
+void GameplayMode::partition_objects(bool top) {
+  _near_objs.clear();
+  _far_objs.clear();
+  
+  const GLOOCamera* cam = get_camera(top);
+  ViewFrustum frustum(*cam);
+  const Point& cam_pos = cam->pos;
+  unsigned int culled = 0;
+  for (GOMap::iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
+    GameObj* obj = i->second.get();
+    float radius = obj->get_bounding_radius();
+    if (radius < 0) {
+      _near_objs.push_back(obj);
+    } else if (!frustum.sees(obj->get_pos(), radius)) {
+      ++culled;
+    } else {
+      // Objects that reach inside the distant projection's near plane would lose that part, so they stay in the near pass
+      // even if they also poke out past its far plane
+      float dist = obj->get_pos().dist_to(cam_pos);
+      if (dist + radius < GAMEPLAY_CLIP_DIST || dist - radius < SKY_NEAR_DIST) {
+        _near_objs.push_back(obj);
+      } else {
+        _far_objs.push_back(obj);
+      }
+    }
+  }
+  
+  Performance::record_culling(_near_objs.size(), _far_objs.size(), culled);
+}
+
+void GameplayMode::draw_3d_far(bool top) {
+  partition_objects(top);
+  
   // Draw all the background objects and setup lights
-  GLOOPushedMatrix pm;
-  Globals::bg->draw_starbox();
-  Vector offset = -Globals::bg->to_center_from_game_origin();
-  glTranslatef(offset.x, offset.y, offset.z);
-  Globals::bg->draw_objects();
+  {
+    GLOOPushedMatrix pm;
+    Globals::bg->draw_starbox();
+    Vector offset = -Globals::bg->to_center_from_game_origin();
+    glTranslatef(offset.x, offset.y, offset.z);
+    Globals::bg->draw_objects();
+  }
+
+  // Game objects that would poke out past the near projection's far plane are drawn with the distant projection instead
+  BOOST_FOREACH(GameObj* obj, _far_objs) {
+    RenderQueue::submit(obj, false);
+  }
+  _far_stats = RenderQueue::flush();
 }
 
 void GameplayMode::draw_3d_near(bool top __attribute__ ((unused))) {
-  // Draw every game object (FIXME Do near/far sorting)
-  for (GOMap::iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
-    i->second->draw(true);
+  BOOST_FOREACH(GameObj* obj, _near_objs) {
+    RenderQueue::submit(obj, true);
   }
+  RenderQueue::Stats near_stats = RenderQueue::flush();
+  
+  Performance::record_batching(
+    _far_stats.draw_calls + near_stats.draw_calls,
+    _far_stats.state_changes + near_stats.state_changes,
+    _far_stats.unsorted_state_changes + near_stats.unsorted_state_changes
+  );
 }
 
 void GameplayMode::draw_2d(bool top __attribute__ ((unused))) {
@@ -181,7 +286,50 @@ void GameplayMode::draw_2d(bool top __attribute__ ((unused))) {
 }
 
 void GameplayMode::step() {
+  // Keep the simulation's coordinates small around the avatar, so that float precision doesn't run out in large areas
+  AvatarGameObj* avatar = find_avatar();
+  Sim::recenter_on(avatar->get_pos());
+  Sim::set_lod_focus(avatar->get_pos());
+  Streaming::step(avatar->get_pos() + Sim::get_origin_offset(), avatar->get_vel());
+  StateHash::step(_fsm);
+  
+  // Checkpoints are captured at the start of the step after a state change, so that restoring one doesn't repeat any FSM step
+  if (_checkpoint_pending) {
+    _checkpoint.capture(_fsm);
+    _checkpoint_pending = false;
+  }
+  
   _fsm.step();
+  
+  if (!_fsm.is_finished() and _fsm.get_state_id() != _checkpoint_state) {
+    _checkpoint_state = _fsm.get_state_id();
+    _checkpoint_pending = _checkpoint_state != _fsm.get_start_state_id();
+  }
+}
+
+void GameplayMode::restart() {
+  Debug::status_msg("Restarting mission");
+  
+  // A recording being made covers only the latest attempt
+  Recording::mission_ended();
+  _start_snapshot.restore(_fsm);
+  _checkpoint.clear();
+  _checkpoint_state = MISSION_STATE_NONE;
+  _checkpoint_pending = false;
+  Rewind::reset();
+  Recording::mission_started();
+}
+
+void GameplayMode::restore_checkpoint() {
+  if (!_checkpoint.is_valid()) {
+    restart();
+    return;
+  }
+  
+  Debug::status_msg("Returning to checkpoint at mission state \"" + _fsm.get_state_name(_checkpoint_state) + "\"");
+  _checkpoint.restore(_fsm);
+  _checkpoint_pending = false;
+  Rewind::reset();
 }
 
 Point GameplayMode::get_condition_widget_pos(const Size& size) const {
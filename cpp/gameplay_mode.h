@@ -23,21 +23,39 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #ifndef ORBIT_RIBBON_GAMEPLAY_MODE_H
 #define ORBIT_RIBBON_GAMEPLAY_MODE_H
 
+#include <vector>
+
 #include "geometry.h"
 
 #include "mode.h"
 #include "mission_fsm.h"
+#include "render_queue.h"
+#include "snapshot.h"
 
 class AvatarGameObj;
+class GameObj;
 
 class GameplayMode : public Mode {
   private:
     MissionFSM _fsm;
-    std::string _avatar_key;
     Point _condition_widget_cursor;
     
+    // The world as it was when the mission began, and as it was when the most recent mission state was entered
+    WorldSnapshot _start_snapshot;
+    WorldSnapshot _checkpoint;
+    int _checkpoint_state;
+    bool _checkpoint_pending;
+    
+    // GameObjs which passed culling this frame, split by whether they fit within the near projection's clip distance
+    std::vector<GameObj*> _near_objs;
+    std::vector<GameObj*> _far_objs;
+    RenderQueue::Stats _far_stats;
+    
+    void partition_objects(bool top);
+  
   public:
     GameplayMode();
+    ~GameplayMode();
     
     AvatarGameObj* find_avatar();
     const AvatarGameObj* find_avatar() const;
@@ -54,6 +72,10 @@ class GameplayMode : public Mode {
     void step();
     
     Point get_condition_widget_pos(const Size& size) const;
+    
+    // Puts the mission back the way it was at the start or at the last checkpoint, without reloading anything
+    void restart();
+    void restore_checkpoint();
 };
 
 
@@ -41,6 +41,159 @@ static const float FOCUSED_COLOR[4] = { 0.6, 0.6, 0.9, 1.0 };
 static const float CHECKED_COLOR[4] = { 0.2, 0.6, 0.0, 1.0 };
 static const float INNER_CHECKED_COLOR[4] = { 0.4, 0.9, 0.1, 1.0 };
 
+// GL calls each shape took when it was drawn on its own: draw_box and draw_diamond_box each set up and restored
+// client state around one draw, and the slider gauge's triangle did the same with its quad drawn inside that setup
+static const unsigned int UNBATCHED_BOX_GL_CALLS = 12;
+static const unsigned int UNBATCHED_GAUGE_TRIANGLE_GL_CALLS = 12;
+static const unsigned int UNBATCHED_GAUGE_QUAD_GL_CALLS = 2;
+
+std::vector<Batch::Run> Batch::_runs;
+unsigned int Batch::_run_count = 0;
+unsigned int Batch::_shapes = 0;
+unsigned int Batch::_draw_calls = 0;
+unsigned int Batch::_gl_calls = 0;
+unsigned int Batch::_unbatched_gl_calls = 0;
+unsigned int Batch::_last_shapes = 0;
+unsigned int Batch::_last_draw_calls = 0;
+unsigned int Batch::_last_gl_calls = 0;
+unsigned int Batch::_last_unbatched_gl_calls = 0;
+
+void Batch::add(Kind kind, GLOOTexture* tex, const BatchVertex* verts, unsigned int count, unsigned int unbatched_gl_calls) {
+  if (kind == UNTEXTURED) {
+    tex = 0;
+  }
+  
+  Bounds b = { verts[0].x, verts[0].y, verts[0].x, verts[0].y };
+  for (unsigned int i = 1; i < count; ++i) {
+    b.x0 = std::min(b.x0, verts[i].x);
+    b.y0 = std::min(b.y0, verts[i].y);
+    b.x1 = std::max(b.x1, verts[i].x);
+    b.y1 = std::max(b.y1, verts[i].y);
+  }
+  
+  // Look back for a run this shape can join without being drawn under anything added after that run
+  Run* target = 0;
+  for (unsigned int r = _run_count; r > 0 && !target; --r) {
+    Run& run = _runs[r - 1];
+    if (run.kind == kind && run.tex == tex) {
+      target = &run;
+    } else {
+      bool blocked = false;
+      BOOST_FOREACH(const Bounds& other, run.shapes) {
+        if (other.overlaps(b)) {
+          blocked = true;
+          break;
+        }
+      }
+      if (blocked) {
+        break;
+      }
+    }
+  }
+  
+  if (!target) {
+    if (_run_count == _runs.size()) {
+      _runs.push_back(Run());
+    }
+    target = &_runs[_run_count++];
+    target->kind = kind;
+    target->tex = tex;
+  }
+  
+  target->verts.insert(target->verts.end(), verts, verts + count);
+  target->shapes.push_back(b);
+  ++_shapes;
+  _unbatched_gl_calls += unbatched_gl_calls;
+}
+
+void Batch::flush() {
+  if (_run_count == 0) {
+    return;
+  }
+  
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  _gl_calls += 6;
+  
+  for (unsigned int r = 0; r < _run_count; ++r) {
+    const std::vector<BatchVertex>& v = _runs[r].verts;
+    Kind kind = _runs[r].kind;
+    if (kind == UNTEXTURED) {
+      glDisable(GL_TEXTURE_2D);
+    } else {
+      _runs[r].tex->bind();
+    }
+    ++_gl_calls;
+    if (kind == TEXT) {
+      // Text takes its color from the vertices and its alpha from the inverse of the glyph texture
+      glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+      glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_REPLACE);
+      glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_RGB, GL_PRIMARY_COLOR);
+      glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR);
+      glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_REPLACE);
+      glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_ALPHA, GL_TEXTURE);
+      glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      _gl_calls += 7;
+    }
+    
+    glVertexPointer(2, GL_FLOAT, sizeof(BatchVertex), &v[0].x);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(BatchVertex), &v[0].u);
+    glColorPointer(4, GL_FLOAT, sizeof(BatchVertex), &v[0].r);
+    glDrawArrays(GL_TRIANGLES, 0, v.size());
+    ++_draw_calls;
+    _gl_calls += 4;
+    
+    if (kind == UNTEXTURED) {
+      glEnable(GL_TEXTURE_2D);
+      ++_gl_calls;
+    } else if (kind == TEXT) {
+      glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+      ++_gl_calls;
+    }
+  }
+  
+  glPopClientAttrib();
+  glColor3f(1.0, 1.0, 1.0);
+  _gl_calls += 2;
+  
+  // The vectors are kept so that their storage can be reused by the next flush
+  for (unsigned int r = 0; r < _run_count; ++r) {
+    _runs[r].verts.clear();
+    _runs[r].shapes.clear();
+  }
+  _run_count = 0;
+}
+
+void Batch::new_frame() {
+  _last_shapes = _shapes;
+  _last_draw_calls = _draw_calls;
+  _last_gl_calls = _gl_calls;
+  _last_unbatched_gl_calls = _unbatched_gl_calls;
+  _shapes = _draw_calls = _gl_calls = _unbatched_gl_calls = 0;
+}
+
+// Adds a solid-colored shape to the batch, given as 2D points and triangle indices into them
+void add_solid_shape(const float* points, const unsigned short* indices, unsigned int index_count, const float* colors, unsigned int color_stride, unsigned int unbatched_gl_calls) {
+  BatchVertex verts[12];
+  for (unsigned int i = 0; i < index_count; ++i) {
+    BatchVertex& v = verts[i];
+    unsigned int p = indices[i];
+    v.x = points[p*2];
+    v.y = points[p*2 + 1];
+    v.u = v.v = 0;
+    const float* c = colors + p*color_stride;
+    v.r = c[0];
+    v.g = c[1];
+    v.b = c[2];
+    v.a = color_stride == 3 ? 1.0 : c[3];
+  }
+  Batch::add(Batch::UNTEXTURED, 0, verts, index_count, unbatched_gl_calls);
+}
+
 void draw_diamond_box(const Box& box, float r, float g, float b, float a) {
   float points[12] = {
     box.top_left.x + DIAMOND_BOX_BORDER.x/2, box.top_left.y,
@@ -51,27 +204,15 @@ void draw_diamond_box(const Box& box, float r, float g, float b, float a) {
     box.top_left.x + box.size.x - DIAMOND_BOX_BORDER.x/2, box.top_left.y + box.size.y
   };
   
-  const static GLushort indices[12] = {
+  const static unsigned short indices[12] = {
     0, 1, 2,
     0, 2, 5,
     5, 3, 0,
     5, 4, 3
   };
 
-  glDisable(GL_TEXTURE_2D);
-  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-  glDisableClientState(GL_NORMAL_ARRAY);
-  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-  
-  glColor4f(r, g, b, a);
-  glVertexPointer(2, GL_FLOAT, 0, points);
-  glDrawElements(GL_TRIANGLES, 12, GL_UNSIGNED_SHORT, indices);
-  glColor3f(1.0, 1.0, 1.0);
-  
-  glPopClientAttrib();
-  glEnable(GL_TEXTURE_2D);
+  float color[4] = { r, g, b, a };
+  add_solid_shape(points, indices, 12, color, 0, UNBATCHED_BOX_GL_CALLS);
 }
 
 void draw_diamond_box(const Box& box, const float* color) {
@@ -86,20 +227,13 @@ void draw_box(const Box& box, float r, float g, float b, float a) {
     box.top_left.x+box.size.x, box.top_left.y,
   };
 
-  glDisable(GL_TEXTURE_2D);
-  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-  glDisableClientState(GL_NORMAL_ARRAY);
-  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-
-  glColor4f(r, g, b, a);
-  glVertexPointer(2, GL_FLOAT, 0, points);
-  glDrawArrays(GL_QUADS, 0, 8);
-  glColor3f(1.0, 1.0, 1.0);
+  const static unsigned short indices[6] = {
+    0, 1, 2,
+    0, 2, 3
+  };
 
-  glPopClientAttrib();
-  glEnable(GL_TEXTURE_2D);
+  float color[4] = { r, g, b, a };
+  add_solid_shape(points, indices, 6, color, 0, UNBATCHED_BOX_GL_CALLS);
 }
 
 void draw_box(const Box& box, const float* color) {
@@ -189,25 +323,15 @@ void Slider::draw(const Box& box) {
     gauge_area.top_left.x + gauge_area.size.x, gauge_area.top_left.y + gauge_area.size.y // Point 4 : Lower right corner
   };
 
-  glDisable(GL_TEXTURE_2D);
-  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-  glDisableClientState(GL_NORMAL_ARRAY);
-  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-  glEnableClientState(GL_COLOR_ARRAY);
-  glVertexPointer(2, GL_FLOAT, 0, gauge_points);
-
-  const static GLushort triangle_indices[3] = { 0, 1, 2 };
+  const static unsigned short triangle_indices[3] = { 0, 1, 2 };
   float triangle_colors[9] = {
     0.5, 0.5, 0.5, // Color 0 : Left tip of triangle
     0.3, 0.3+(0.6*_value), 0.3, // Color 1 : Bottom of gauge line
     0.3, 0.3+(0.6*_value), 0.3 // Color 2 : Top of gauge line
   };
-  glColorPointer(3, GL_FLOAT, 0, triangle_colors);
-  glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, triangle_indices);
+  add_solid_shape(gauge_points, triangle_indices, 3, triangle_colors, 3, UNBATCHED_GAUGE_TRIANGLE_GL_CALLS);
 
-  const static GLushort quad_indices[4] = { 4, 3, 2, 1 };
+  const static unsigned short quad_indices[6] = { 4, 3, 2, 4, 2, 1 };
   float quad_colors[15] = { // TODO: Maybe make this area a pretty gradient too
     0.0, 0.0, 0.0,
     0.1, 0.1, 0.1,
@@ -215,11 +339,7 @@ void Slider::draw(const Box& box) {
     0.1, 0.1, 0.1,
     0.1, 0.1, 0.1
   };
-  glColorPointer(3, GL_FLOAT, 0, quad_colors);
-  glDrawElements(GL_QUADS, 4, GL_UNSIGNED_SHORT, quad_indices);
-
-  glPopClientAttrib();
-  glEnable(GL_TEXTURE_2D);
+  add_solid_shape(gauge_points, quad_indices, 6, quad_colors, 3, UNBATCHED_GAUGE_QUAD_GL_CALLS);
 
   int font_height = box.size.y - DIAMOND_BOX_BORDER.y*2;
   Globals::sys_font->draw(gauge_dbox_area.top_left + gauge_dbox_area.size.x*1.1, font_height, _label);
@@ -26,12 +26,63 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include <string>
 #include <map>
 #include <list>
+#include <vector>
 
 #include "geometry.h"
 
+class GLOOTexture;
 
 namespace GUI {
   const Vector DIAMOND_BOX_BORDER(8, 2); // A diamond box's contents are drawn this number of pixels from the left/right and top/bottom of the box respectively
+  
+  struct BatchVertex {
+    float x, y, u, v;
+    float r, g, b, a;
+  };
+  
+  // Collects the triangles drawn during a mode's draw_2d into runs that share GL state, each drawn with one call.
+  // A shape joins an earlier run with the same state only if nothing added since that run overlaps it, so the result
+  // looks the same as drawing everything in call order. ModeStack flushes after each mode; anything drawing with GL
+  // directly in draw_2d has to flush first if it needs to appear above what was added before it.
+  class Batch {
+    public:
+      enum Kind { UNTEXTURED, TEXT, TEXTURED };
+      
+      // Adds triangles, three vertices each; tex is ignored for UNTEXTURED
+      // unbatched_gl_calls is how many GL calls the shape took back when it was drawn on its own, for comparison
+      static void add(Kind kind, GLOOTexture* tex, const BatchVertex* verts, unsigned int count, unsigned int unbatched_gl_calls);
+      
+      static void flush();
+      
+      // Counts for the previous frame: shapes added, each of which used to be drawn with its own call, and the draw calls that were made
+      static unsigned int get_shape_count() { return _last_shapes; }
+      static unsigned int get_draw_call_count() { return _last_draw_calls; }
+      
+      // GL calls made by flushing in the previous frame, and how many drawing the same shapes one at a time used to take
+      static unsigned int get_gl_call_count() { return _last_gl_calls; }
+      static unsigned int get_unbatched_gl_call_count() { return _last_unbatched_gl_calls; }
+      
+      static void new_frame();
+    
+    private:
+      struct Bounds {
+        float x0, y0, x1, y1;
+        bool overlaps(const Bounds& other) const { return x0 < other.x1 && other.x0 < x1 && y0 < other.y1 && other.y0 < y1; }
+      };
+      
+      struct Run {
+        Kind kind;
+        GLOOTexture* tex;
+        std::vector<BatchVertex> verts;
+        std::vector<Bounds> shapes; // Bounds of each shape added to this run
+      };
+      
+      // Only the first _run_count are in use; the rest keep their storage for reuse after a flush
+      static std::vector<Run> _runs;
+      static unsigned int _run_count;
+      static unsigned int _shapes, _draw_calls, _gl_calls, _unbatched_gl_calls;
+      static unsigned int _last_shapes, _last_draw_calls, _last_gl_calls, _last_unbatched_gl_calls;
+  };
 
   void draw_diamond_box(const Box& box, float r = 0.0, float g = 0.0, float b = 0.0, float a = 0.5);
   void draw_diamond_box(const Box& box, const float* color);
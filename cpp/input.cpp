@@ -617,12 +617,42 @@ std::string MultiAndChannel::desc(unsigned int desc_type) const {
   return ret;
 }
 
+void ReplayChannel::set_state(bool on, bool partially_on, bool frame_match, float value) {
+  _on = on;
+  _partially_on = partially_on;
+  _frame_match = frame_match;
+  _value = value;
+}
+
+std::string ReplayChannel::desc(unsigned int desc_type __attribute__ ((unused))) const {
+  return "Replay";
+}
+
+ReplayChannel& ReplayChannelSource::axis_channel(ORSave::AxisBoundAction::value_type action) {
+  std::map<ORSave::AxisBoundAction::value_type, unsigned int>::iterator i = _axis_map.find(action);
+  if (i == _axis_map.end()) {
+    i = _axis_map.insert(std::make_pair(action, (unsigned int)_channels.size())).first;
+    _channels.push_back(boost::shared_ptr<Channel>(new ReplayChannel));
+  }
+  return static_cast<ReplayChannel&>(*_channels[i->second]);
+}
+
+ReplayChannel& ReplayChannelSource::button_channel(ORSave::ButtonBoundAction::value_type action) {
+  std::map<ORSave::ButtonBoundAction::value_type, unsigned int>::iterator i = _button_map.find(action);
+  if (i == _button_map.end()) {
+    i = _button_map.insert(std::make_pair(action, (unsigned int)_channels.size())).first;
+    _channels.push_back(boost::shared_ptr<Channel>(new ReplayChannel));
+  }
+  return static_cast<ReplayChannel&>(*_channels[i->second]);
+}
+
 boost::shared_ptr<Channel> Input::_null_channel;
 
 boost::shared_ptr<Keyboard> Input::_kbd;
 boost::shared_ptr<Mouse> Input::_mouse;
 boost::shared_ptr<GamepadManager> Input::_gp_man;
 std::vector<ChannelSource*> Input::_sources;
+boost::shared_ptr<ReplayChannelSource> Input::_replay;
 
 std::map<ORSave::AxisBoundAction::value_type, boost::shared_ptr<Channel> > Input::_axis_action_map;
 std::map<ORSave::ButtonBoundAction::value_type, boost::shared_ptr<Channel> > Input::_button_action_map;
@@ -657,6 +687,7 @@ void Input::deinit() {
 
   _sources.clear();
 
+  _replay.reset();
   _gp_man.reset();
   _mouse.reset();
   _kbd.reset();
@@ -868,6 +899,7 @@ void Input::set_channels_from_config() {
   insert_binding(ORSave::ButtonBoundAction::Pause, _kbd->key_channel(SDLK_PAUSE), _button_action_map);
   insert_binding(ORSave::ButtonBoundAction::ResetNeutral, _kbd->key_channel(SDLK_F10), _button_action_map);
   insert_binding(ORSave::ButtonBoundAction::ForceQuit, _kbd->key_channel(SDLK_F4), _button_action_map);
+  insert_binding(ORSave::ButtonBoundAction::Rewind, _kbd->key_channel(SDLK_BACKSPACE), _button_action_map);
   
   // Bind channels for the fixed default mouse button mappings
   insert_binding(ORSave::ButtonBoundAction::Confirm, _mouse->button_channel(1), _button_action_map);
@@ -889,7 +921,20 @@ const ORSave::PresetType& Input::get_preset(const std::string& name) {
   throw GameException("Unable to load preset named '" + name + "'");
 }
 
+ReplayChannelSource& Input::start_replay() {
+  _replay.reset(new ReplayChannelSource);
+  return *_replay;
+}
+
+void Input::stop_replay() {
+  _replay.reset();
+}
+
 const Channel& Input::get_axis_ch(ORSave::AxisBoundAction::value_type action) {
+  if (_replay) {
+    return _replay->axis_channel(action);
+  }
+  
   std::map<ORSave::AxisBoundAction::value_type, boost::shared_ptr<Channel> >::iterator i = _axis_action_map.find(action);
   if (i != _axis_action_map.end()) {
     return *(i->second);
@@ -898,6 +943,11 @@ const Channel& Input::get_axis_ch(ORSave::AxisBoundAction::value_type action) {
 }
 
 const Channel& Input::get_button_ch(ORSave::ButtonBoundAction::value_type action) {
+  // ForceQuit stays live, so that a replay can always be interrupted
+  if (_replay && action != ORSave::ButtonBoundAction::ForceQuit) {
+    return _replay->button_channel(action);
+  }
+  
   std::map<ORSave::ButtonBoundAction::value_type, boost::shared_ptr<Channel> >::iterator i = _button_action_map.find(action);
   if (i != _button_action_map.end()) {
     return *(i->second);
@@ -311,7 +311,47 @@ class MultiAndChannel : public MultiChannel {
     std::string desc(unsigned int desc_type = CHANNEL_DESC_TYPE_ALL) const;
 };
 
+// A channel whose state is set from a recording rather than read from a device
+class ReplayChannel : public Channel {
+  private:
+    bool _on;
+    bool _partially_on;
+    bool _frame_match;
+    float _value;
+  
+  public:
+    ReplayChannel() : _on(false), _partially_on(false), _frame_match(false), _value(0.0) {}
+    
+    void set_state(bool on, bool partially_on, bool frame_match, float value);
+    
+    bool is_on() const { return _on; }
+    bool is_partially_on() const { return _partially_on; }
+    bool matches_frame_events() const { return _frame_match; }
+    float get_value() const { return _value; }
+    std::string desc(unsigned int desc_type = CHANNEL_DESC_TYPE_ALL) const;
+};
+
+// While a replay is running, this source's channels stand in for the bound channels of every action
+class ReplayChannelSource : public ChannelSource {
+  private:
+    friend class Input;
+    
+    // Key is the bound action, value is index into _channels
+    std::map<ORSave::AxisBoundAction::value_type, unsigned int> _axis_map;
+    std::map<ORSave::ButtonBoundAction::value_type, unsigned int> _button_map;
+    
+    ReplayChannelSource() {}
+  
+  public:
+    // Channel state only changes as the replay advances, not on each frame
+    void update() {}
+    
+    ReplayChannel& axis_channel(ORSave::AxisBoundAction::value_type action);
+    ReplayChannel& button_channel(ORSave::ButtonBoundAction::value_type action);
+};
+
 class App;
+class Recording;
 
 class Input {
   private:
@@ -321,6 +361,7 @@ class Input {
     static boost::shared_ptr<Mouse> _mouse;
     static boost::shared_ptr<GamepadManager> _gp_man;
     static std::vector<ChannelSource*> _sources;
+    static boost::shared_ptr<ReplayChannelSource> _replay;
     
     static std::map<ORSave::AxisBoundAction::value_type, boost::shared_ptr<Channel> > _axis_action_map;
     static std::map<ORSave::ButtonBoundAction::value_type, boost::shared_ptr<Channel> > _button_action_map;
@@ -333,7 +374,12 @@ class Input {
     static void set_neutral();
     static boost::shared_ptr<Channel> xml_to_channel(const ORSave::BoundInputType& i);
     
+    // While replaying, every action except ForceQuit is read from the returned source instead of from the bound channels
+    static ReplayChannelSource& start_replay();
+    static void stop_replay();
+    
     friend class App;
+    friend class Recording;
   
   public:
     static const float DEAD_ZONE;
@@ -20,8 +20,15 @@ You should have received a copy of the GNU General Public License
 along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 */
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <sstream>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -33,86 +40,93 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 
 #include "mesh.h"
 #include "ore.h"
+#include "render_queue.h"
 #include "sim.h"
+#include "streaming.h"
 
 class _MeshAnimationParser : public OREAnim1::AnimationType_pskel {
   private:
-    boost::shared_ptr<MeshAnimation> _anim_p;
+    boost::shared_ptr<PreparedMeshFile> _file;
   
   public:
     void pre() {
-      _anim_p = boost::shared_ptr<MeshAnimation>(new MeshAnimation());
+      _file = boost::shared_ptr<PreparedMeshFile>(new PreparedMeshFile());
     }
     
-    void frame(boost::shared_ptr<GLOOBufferedMesh> mesh) {
-      _anim_p->_frames.push_back(mesh);
+    void frame(PreparedMeshFrame* frame) {
+      _file->frames.push_back(PreparedMeshFrame());
+      PreparedMeshFrame& f = _file->frames.back();
+      f.data.verts.swap(frame->data.verts);
+      f.data.tris.swap(frame->data.tris);
+      f.tex_name.swap(frame->tex_name);
     }
     
     void name(const std::string& n) {
-      _anim_p->_name = n;
+      _file->name = n;
     }
     
-    boost::shared_ptr<MeshAnimation> post_AnimationType() {
-      boost::shared_ptr<MeshAnimation> ret = _anim_p;
-      _anim_p.reset();
+    boost::shared_ptr<PreparedMeshFile> post_AnimationType() {
+      boost::shared_ptr<PreparedMeshFile> ret = _file;
+      _file.reset();
       return ret;
     }
 };
 
+// Vertices and faces are collected on the CPU; nothing here touches GL, so parsing can happen on any thread
 class _MeshParser : public OREAnim1::MeshType_pskel {
   private:
-    boost::shared_ptr<GLOOBufferedMesh> _mesh;
+    PreparedMeshFrame _frame;
     unsigned int _verts, _faces;
-    std::string _tex_name;
-    
-    void init_mesh() {
-      if (!_mesh) {
-        if (_verts == 0 || _faces == 0) {
-          throw OreException("Unable to create GLOOBufferedMesh without allocation attributes");
-        }
-        boost::shared_ptr<GLOOTexture> _tex;
-        if (_tex_name.size() > 0) {
-          _tex = GLOOTexture::load(_tex_name);
-        }
-        // FIXME Don't always have trimesh data creaed; it's not necessary for all models
-        _mesh = GLOOBufferedMesh::create(_verts, _faces, _tex, true);
-      }
-    }
   
   public:
     void pre() {
-      _mesh.reset();
+      _frame = PreparedMeshFrame();
       _verts = _faces = 0;
-      _tex_name = "";
     }
     
     void f(GLOOFace* face) {
-      init_mesh();
-      _mesh->load_face(*face);
+      MeshTriangle t;
+      t.a = face->a;
+      t.b = face->b;
+      t.c = face->c;
+      _frame.data.tris.push_back(t);
     }
     
     void v(GLOOVertex* v) {
-      init_mesh();
-      _mesh->load_vertex(*v);
+      MeshVertex mv;
+      mv.x = v->x; mv.y = v->y; mv.z = v->z;
+      mv.nx = v->nx; mv.ny = v->ny; mv.nz = v->nz;
+      mv.u = v->u; mv.v = v->v;
+      _frame.data.verts.push_back(mv);
     }
     
     void texture(const std::string& tex_name) {
-      _tex_name = tex_name;
+      _frame.tex_name = tex_name;
     }
     
     void vertcount(unsigned int c) {
       _verts = c;
+      _frame.data.verts.reserve(c);
     }
     
     void facecount(unsigned int c) {
       _faces = c;
+      _frame.data.tris.reserve(c);
     }
     
-    boost::shared_ptr<GLOOBufferedMesh> post_MeshType() {
-      boost::shared_ptr<GLOOBufferedMesh> ret = _mesh;
-      _mesh.reset();
-      ret->finish_loading();
-      return ret;
+    PreparedMeshFrame* post_MeshType() {
+      if (_verts == 0 || _faces == 0) {
+        throw OreException("Unable to create GLOOBufferedMesh without allocation attributes");
+      }
+      if (_frame.data.verts.size() != _verts || _frame.data.tris.size() != _faces) {
+        throw OreException("Mesh vertex or face count doesn't match its allocation attributes");
+      }
+      BOOST_FOREACH(const MeshTriangle& t, _frame.data.tris) {
+        if (t.a >= _verts || t.b >= _verts || t.c >= _verts) {
+          throw OreException("Mesh face refers to a nonexistent vertex");
+        }
+      }
+      return &_frame;
     }
 };
 
@@ -123,7 +137,7 @@ class _FaceParser : public OREAnim1::FaceType_pskel {
   
   public:
     _FaceParser() : OREAnim1::FaceType_pskel(0) { }
-
+    
     void pre() {
       _idx = 0;
     }
@@ -153,7 +167,7 @@ class _FaceParser : public OREAnim1::FaceType_pskel {
 class _VertexParser : public OREAnim1::VertexType_pskel {
   private:
     GLOOVertex _vert;
-    
+  
   public:
     void p(boost::array<float,3>* pos) {
       _vert.x = pos->at(0);
@@ -243,7 +257,7 @@ class _MeshParsingRig {
       uv_parser.parsers(float_parser);
     }
     
-    boost::shared_ptr<MeshAnimation> parse(OreFileHandle& fh) {
+    boost::shared_ptr<PreparedMeshFile> parse(std::istream& fh) {
       xml_schema::document_pimpl doc_p(anim_parser, "http://www.orbit-ribbon.org/OREAnim1", "animation");
       anim_parser.pre();
       doc_p.parse(fh);
@@ -251,13 +265,170 @@ class _MeshParsingRig {
     }
 };
 
-_MeshParsingRig parsing_rig;
+// Size of the FIFO vertex cache simulated when logging how much reordering helped
+const unsigned int ACMR_CACHE_SIZE = 16;
+
+// Collision data lives in CollisionMesh, so the GL meshes never have trimesh data of their own
+boost::shared_ptr<GLOOBufferedMesh> create_buffered_mesh(const MeshData& data, const boost::shared_ptr<GLOOTexture>& tex) {
+  boost::shared_ptr<GLOOBufferedMesh> mesh = GLOOBufferedMesh::create(data.verts.size(), data.tris.size(), tex, false);
+  BOOST_FOREACH(const MeshVertex& mv, data.verts) {
+    GLOOVertex v;
+    v.x = mv.x; v.y = mv.y; v.z = mv.z;
+    v.nx = mv.nx; v.ny = mv.ny; v.nz = mv.nz;
+    v.u = mv.u; v.v = mv.v;
+    mesh->load_vertex(v);
+  }
+  BOOST_FOREACH(const MeshTriangle& t, data.tris) {
+    GLOOFace f;
+    f.a = t.a;
+    f.b = t.b;
+    f.c = t.c;
+    mesh->load_face(f);
+  }
+  mesh->finish_loading();
+  return mesh;
+}
+
+// Meshes with fewer triangles than this aren't worth decimating
+const unsigned int MESH_LOD_MIN_TRIS = 200;
+
+// Each level of detail aims for this fraction of the previous level's triangles
+const float MESH_LOD_REDUCTION = 0.4;
+
+// Most levels of detail generated per mesh, in addition to the full mesh
+const unsigned int MESH_LOD_MAX_LEVELS = 2;
+
+// On-screen bounding radius in pixels below which each successive level of detail is used
+const float MESH_LOD_PIXEL_THRESHOLDS[MESH_LOD_MAX_LEVELS] = { 150, 40 };
+
+boost::shared_ptr<PreparedMeshFile> MeshAnimation::prepare(std::istream& is, bool collision_only) {
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  
+  // Each call has its own parsers, since this may be running on the streaming prefetch thread
+  _MeshParsingRig rig;
+  boost::shared_ptr<PreparedMeshFile> file = rig.parse(is);
+  if (collision_only) {
+    if (file->frames.size() > 1) {
+      file->frames.resize(1);
+    }
+    return file;
+  }
+  
+  float max_sq_radius = 0;
+  BOOST_FOREACH(PreparedMeshFrame& frame, file->frames) {
+    BOOST_FOREACH(const MeshVertex& v, frame.data.verts) {
+      max_sq_radius = std::max(max_sq_radius, v.x*v.x + v.y*v.y + v.z*v.z);
+    }
+    
+    file->total_tris += frame.data.tris.size();
+    file->misses_before += count_cache_misses(frame.data, ACMR_CACHE_SIZE);
+    optimize_vertex_cache(frame.data);
+    file->misses_after += count_cache_misses(frame.data, ACMR_CACHE_SIZE);
+  }
+  file->bounding_radius = std::sqrt(max_sq_radius);
+  
+  if (!file->frames.empty() && file->frames[0].data.tris.size() >= MESH_LOD_MIN_TRIS) {
+    file->lods.reserve(MESH_LOD_MAX_LEVELS);
+    const MeshData* prev = &file->frames[0].data;
+    for (unsigned int level = 0; level < MESH_LOD_MAX_LEVELS; ++level) {
+      MeshData lod_data = decimate_mesh(*prev, (unsigned int)(prev->tris.size()*MESH_LOD_REDUCTION));
+      
+      // Stop once the decimator can't get much further, usually because what's left is mostly open edges
+      if (lod_data.tris.size() == 0 || lod_data.tris.size() > prev->tris.size()*0.9) {
+        break;
+      }
+      
+      // Collapses leave the surviving triangles in their old order, which has gaps where the removed ones were
+      optimize_vertex_cache(lod_data);
+      file->lods.push_back(lod_data);
+      
+      // Each level is decimated from the one before it, which is much cheaper than starting from the full mesh again
+      prev = &file->lods.back();
+    }
+  }
+  
+  file->prepare_ms = (boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds();
+  return file;
+}
+
+boost::shared_ptr<MeshAnimation> MeshAnimation::build(const PreparedMeshFile& file) {
+  boost::shared_ptr<MeshAnimation> ret(new MeshAnimation());
+  ret->_name = file.name;
+  ret->_bounding_radius = file.bounding_radius;
+  
+  BOOST_FOREACH(const PreparedMeshFrame& frame, file.frames) {
+    boost::shared_ptr<GLOOTexture> tex;
+    if (frame.tex_name.size() > 0) {
+      tex = GLOOTexture::load(frame.tex_name);
+    }
+    ret->_frames.push_back(create_buffered_mesh(frame.data, tex));
+  }
+  if (file.frames.empty()) {
+    return ret;
+  }
+  
+  // The levels of detail are all made from the first frame, so they use its texture
+  const PreparedMeshFrame& first = file.frames[0];
+  ret->_render_state_id = RenderQueue::get_state_id("mesh-tex:" + first.tex_name);
+  ret->_lod_tris.push_back(first.data.tris.size());
+  boost::shared_ptr<GLOOTexture> first_tex;
+  if (first.tex_name.size() > 0) {
+    first_tex = GLOOTexture::load(first.tex_name);
+  }
+  BOOST_FOREACH(const MeshData& lod_data, file.lods) {
+    ret->_lods.push_back(create_buffered_mesh(lod_data, first_tex));
+    ret->_lod_tris.push_back(lod_data.tris.size());
+  }
+  
+  std::string counts;
+  BOOST_FOREACH(unsigned int n, ret->_lod_tris) {
+    counts += (counts.empty() ? "" : "/") + boost::lexical_cast<std::string>(n);
+  }
+  Debug::debug_msg((boost::format("Prepared %s in %ums: ACMR %.3f -> %.3f, LOD triangles %s")
+    % file.name
+    % file.prepare_ms
+    % (file.total_tris > 0 ? float(file.misses_before)/file.total_tris : 0)
+    % (file.total_tris > 0 ? float(file.misses_after)/file.total_tris : 0)
+    % counts
+  ).str());
+  return ret;
+}
+
+// While a MeshGameObj loads its animation and collision mesh, their prepared file is kept so it's only parsed once
+static std::string shared_mesh_file_id;
+static boost::shared_ptr<PreparedMeshFile> shared_mesh_file;
+
+static boost::shared_ptr<PreparedMeshFile> get_prepared_mesh_file(const std::string& id, bool collision_only) {
+  if (id == shared_mesh_file_id && shared_mesh_file) {
+    return shared_mesh_file;
+  }
+  
+  // Streamed scenery has usually been read and prepared already by the prefetch thread
+  boost::shared_ptr<PreparedMeshFile> file;
+  if (!Streaming::take_prefetched(id, file)) {
+    boost::shared_ptr<std::istream> fh = Globals::ore->get_fh(id);
+    file = MeshAnimation::prepare(*fh, collision_only && id != shared_mesh_file_id);
+  }
+  if (id == shared_mesh_file_id) {
+    shared_mesh_file = file;
+  }
+  return file;
+}
+
+static void end_shared_mesh_file() {
+  shared_mesh_file_id.clear();
+  shared_mesh_file.reset();
+}
+
+static boost::shared_ptr<MeshAnimation> load_sharing_mesh_file(const std::string& name) {
+  shared_mesh_file_id = name;
+  return MeshAnimation::load(name);
+}
 
 class MeshAnimationCache : public CacheBase<MeshAnimation> {
   boost::shared_ptr<MeshAnimation> generate(const std::string& id) {
-    boost::shared_ptr<OreFileHandle> fh = Globals::ore->get_fh(id);
     try {
-      return parsing_rig.parse(*fh);
+      return MeshAnimation::build(*get_prepared_mesh_file(id, false));
     } catch (const std::exception& e) {
       throw GameException("Unable to parse MeshAnimation " + id + " : " + e.what());
     }
@@ -266,6 +437,28 @@ class MeshAnimationCache : public CacheBase<MeshAnimation> {
 
 MeshAnimationCache mesh_animation_cache;
 
+class CollisionMeshCache : public CacheBase<CollisionMesh> {
+  boost::shared_ptr<CollisionMesh> generate(const std::string& id) {
+    boost::shared_ptr<PreparedMeshFile> file;
+    try {
+      file = get_prepared_mesh_file(id, true);
+    } catch (const std::exception& e) {
+      throw GameException("Unable to parse CollisionMesh " + id + " : " + e.what());
+    }
+    if (file->frames.empty()) {
+      throw GameException("CollisionMesh " + id + " has no frames");
+    }
+    return boost::shared_ptr<CollisionMesh>(new CollisionMesh(file->frames[0].data));
+  }
+};
+
+CollisionMeshCache collision_mesh_cache;
+
+unsigned int MeshAnimation::_tris_drawn = 0;
+unsigned int MeshAnimation::_tris_saved = 0;
+unsigned int MeshAnimation::_last_tris_drawn = 0;
+unsigned int MeshAnimation::_last_tris_saved = 0;
+
 boost::shared_ptr<MeshAnimation> MeshAnimation::load(const std::string& name) {
   return mesh_animation_cache.get(name);
 }
@@ -276,10 +469,129 @@ void MeshAnimation::draw() {
     throw GameException("No frames loaded in animation '" + _name + "'!");
   }
   _frames[0]->draw();
+  _tris_drawn += _lod_tris[0];
+}
+
+void MeshAnimation::draw(float screen_radius) {
+  unsigned int level = 0;
+  while (level < _lods.size() && screen_radius < MESH_LOD_PIXEL_THRESHOLDS[level]) {
+    ++level;
+  }
+  
+  if (level == 0) {
+    draw();
+  } else {
+    // The levels of detail are only built from the first frame, which is all draw() uses anyway
+    _lods[level - 1]->draw();
+    _tris_drawn += _lod_tris[level];
+    _tris_saved += _lod_tris[0] - _lod_tris[level];
+  }
+}
+
+void MeshAnimation::new_frame() {
+  _last_tris_drawn = _tris_drawn;
+  _last_tris_saved = _tris_saved;
+  _tris_drawn = 0;
+  _tris_saved = 0;
+}
+
+CollisionMesh::CollisionMesh(const MeshData& data) :
+  _trimesh_data(0)
+{
+  _positions.reserve(data.verts.size()*3);
+  _normals.reserve(data.verts.size()*3);
+  BOOST_FOREACH(const MeshVertex& v, data.verts) {
+    _positions.push_back(v.x);
+    _positions.push_back(v.y);
+    _positions.push_back(v.z);
+    _normals.push_back(v.nx);
+    _normals.push_back(v.ny);
+    _normals.push_back(v.nz);
+  }
+  
+  _indices.reserve(data.tris.size()*3);
+  BOOST_FOREACH(const MeshTriangle& t, data.tris) {
+    _indices.push_back(t.a);
+    _indices.push_back(t.b);
+    _indices.push_back(t.c);
+  }
+}
+
+std::map<dTriMeshDataID, CollisionMesh*> CollisionMesh::_by_trimesh_data;
+
+CollisionMesh::~CollisionMesh() {
+  if (_trimesh_data) {
+    _by_trimesh_data.erase(_trimesh_data);
+    dGeomTriMeshDataDestroy(_trimesh_data);
+  }
+}
+
+boost::shared_ptr<CollisionMesh> CollisionMesh::load(const std::string& name) {
+  return collision_mesh_cache.get(name);
+}
+
+dTriMeshDataID CollisionMesh::get_trimesh_data() {
+  if (!_trimesh_data) {
+    // ODE keeps pointers into these arrays rather than copying them
+    _trimesh_data = dGeomTriMeshDataCreate();
+    dGeomTriMeshDataBuildSingle(
+      _trimesh_data,
+      &_positions[0], 3*sizeof(float), _positions.size()/3,
+      &_indices[0], _indices.size(), 3*sizeof(dTriIndex)
+    );
+    _by_trimesh_data[_trimesh_data] = this;
+  }
+  return _trimesh_data;
+}
+
+const CollisionMesh* CollisionMesh::get_from_geom(dGeomID geom) {
+  if (dGeomGetClass(geom) != dTriMeshClass) {
+    return 0;
+  }
+  std::map<dTriMeshDataID, CollisionMesh*>::const_iterator i = _by_trimesh_data.find(dGeomTriMeshGetData(geom));
+  return i == _by_trimesh_data.end() ? 0 : i->second;
+}
+
+Vector CollisionMesh::get_interpolated_normal(dGeomID geom, const Point& pos, int tri) const {
+  if (tri < 0 or (unsigned int)(tri*3 + 2) >= _indices.size()) {
+    throw GameException("CollisionMesh: Triangle index out of range for interpolated normal");
+  }
+  
+  Point verts[3];
+  Vector norms[3];
+  for (unsigned int n = 0; n < 3; ++n) {
+    unsigned int v = _indices[tri*3 + n]*3;
+    verts[n] = Point(_positions[v], _positions[v+1], _positions[v+2]);
+    norms[n] = Vector(_normals[v], _normals[v+1], _normals[v+2]);
+  }
+  
+  Vector bary = get_barycentric(OdeGeomUtil::get_pos_rel_point(geom, pos), verts[0], verts[1], verts[2]);
+  Vector local = norms[0]*bary.x + norms[1]*bary.y + norms[2]*bary.z;
+  return OdeGeomUtil::vector_to_world(geom, local).to_length(1.0);
+}
+
+void CollisionMesh::get_aabb(float* aabb) const {
+  for (unsigned int axis = 0; axis < 3; ++axis) {
+    aabb[axis*2] = std::numeric_limits<float>::max();
+    aabb[axis*2 + 1] = -std::numeric_limits<float>::max();
+  }
+  for (unsigned int i = 0; i < _positions.size(); ++i) {
+    unsigned int axis = i % 3;
+    aabb[axis*2] = std::min(aabb[axis*2], _positions[i]);
+    aabb[axis*2 + 1] = std::max(aabb[axis*2 + 1], _positions[i]);
+  }
 }
 
 void MeshGameObj::near_draw_impl() {
-  _mesh_anim->draw();
+  _mesh_anim->draw(RenderQueue::get_screen_radius(get_pos(), _mesh_anim->get_bounding_radius()));
+}
+
+float MeshGameObj::get_bounding_radius() const {
+  return _mesh_anim->get_bounding_radius();
+}
+
+RenderState MeshGameObj::get_render_state() const {
+  return _mesh_anim->get_render_state();
 }
 
 // Set MeshGameObj as the default type for unknown GameObjs
@@ -287,11 +599,13 @@ AutoDefaultRegistration<GameObjFactorySpec, MeshGameObj> mesh_gameobj_reg;
 
 MeshGameObj::MeshGameObj(const ORE1::ObjType& obj) :
   GameObj(obj),
-  _mesh_anim(MeshAnimation::load(std::string("mesh-") + obj.dataName()))
+  _mesh_anim(load_sharing_mesh_file(std::string("mesh-") + obj.dataName())),
+  _coll_mesh(CollisionMesh::load(std::string("mesh-") + obj.dataName()))
 {
+  end_shared_mesh_file();
   get_entity().set_geom(
     "physical",
-    dCreateTriMesh(Sim::get_static_space(), _mesh_anim->get_trimesh_data(0), 0, 0, 0),
-    std::auto_ptr<CollisionHandler>(new SimpleContactHandler)
+    dCreateTriMesh(Sim::get_static_space(), _coll_mesh->get_trimesh_data(), 0, 0, 0),
+    std::auto_ptr<CollisionHandler>(new SimpleContactHandler(CollisionHandler::PASSIVE))
   );
 }
@@ -23,6 +23,8 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #ifndef ORBIT_RIBBON_MESH_H
 #define ORBIT_RIBBON_MESH_H
 
+#include <istream>
+#include <map>
 #include <string>
 #include <vector>
 #include <boost/shared_ptr.hpp>
@@ -30,15 +32,113 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include <ode/ode.h>
 
 #include "gameobj.h"
+#include "mesh_processing.h"
 
 namespace ORE1 { class ObjType; }
+class GLOOBufferedMesh;
+class GLOOTexture;
+
+struct PreparedMeshFrame {
+  MeshData data;
+  std::string tex_name;
+};
+
+// Everything read and worked out from a mesh file before any of it goes to GL
+struct PreparedMeshFile {
+  std::string name;
+  std::vector<PreparedMeshFrame> frames; // Each already reordered for the vertex cache
+  std::vector<MeshData> lods; // Decimated copies of the first frame, each coarser than the last
+  float bounding_radius; // Furthest any vertex in any frame gets from the mesh origin
+  unsigned int total_tris, misses_before, misses_after; // Vertex cache misses in all frames, before and after reordering
+  unsigned int prepare_ms;
+  
+  PreparedMeshFile() : bounding_radius(0), total_tris(0), misses_before(0), misses_after(0), prepare_ms(0) {}
+};
+
+class MeshAnimation : boost::noncopyable {
+  private:
+    std::string _name;
+    std::vector<boost::shared_ptr<GLOOBufferedMesh> > _frames;
+    float _bounding_radius; // Furthest any vertex in any frame gets from the mesh origin
+    unsigned int _render_state_id; // RenderQueue state for the first frame's texture
+    
+    // Decimated copies of the first frame, each coarser than the last, generated when the animation is loaded
+    std::vector<boost::shared_ptr<GLOOBufferedMesh> > _lods;
+    std::vector<unsigned int> _lod_tris; // Triangle counts of the first frame, then of each of _lods
+    
+    // Triangles drawn by all animations so far this frame, and how many more there would have been at full detail
+    static unsigned int _tris_drawn, _tris_saved;
+    static unsigned int _last_tris_drawn, _last_tris_saved;
+    
+    MeshAnimation() : _bounding_radius(0), _render_state_id(0) {}
+  
+  public:
+    static boost::shared_ptr<MeshAnimation> load(const std::string& name);
+    
+    // Parses a mesh file, reorders it for the vertex cache and generates its levels of detail. This doesn't touch
+    // GL or any shared state, so the streaming prefetch thread calls it too. With collision_only, only the first
+    // frame is kept and nothing is reordered or decimated.
+    static boost::shared_ptr<PreparedMeshFile> prepare(std::istream& is, bool collision_only);
+    
+    // Creates the textures and GL meshes for a prepared file; main thread only
+    static boost::shared_ptr<MeshAnimation> build(const PreparedMeshFile& file);
+    
+    float get_bounding_radius() const { return _bounding_radius; }
+    RenderState get_render_state() const { return RenderState(_render_state_id, this); }
+    
+    // Draws at full detail
+    void draw();
+    
+    // Draws at the level of detail suited to how many pixels the bounding radius covers on screen
+    void draw(float screen_radius);
+    
+    // Triangle counts for the previous frame
+    static unsigned int get_tris_drawn() { return _last_tris_drawn; }
+    static unsigned int get_tris_saved() { return _last_tris_saved; }
+    static void new_frame();
+};
+
+// Positions and faces of a mesh's first frame, for collision geoms; each mesh file has at most one, shared by every geom using it
+class CollisionMesh : boost::noncopyable {
+  private:
+    std::vector<float> _positions;
+    std::vector<float> _normals; // One per vertex, for smoothing out contact normals across faces
+    std::vector<dTriIndex> _indices;
+    dTriMeshDataID _trimesh_data; // Not built until the first call to get_trimesh_data
+    
+    static std::map<dTriMeshDataID, CollisionMesh*> _by_trimesh_data;
+  
+  public:
+    explicit CollisionMesh(const MeshData& data);
+    ~CollisionMesh();
+    
+    static boost::shared_ptr<CollisionMesh> load(const std::string& name);
+    
+    dTriMeshDataID get_trimesh_data();
+    
+    // Returns the CollisionMesh whose trimesh data the given geom uses, or 0 if it isn't a trimesh from a CollisionMesh
+    static const CollisionMesh* get_from_geom(dGeomID geom);
+    
+    // Returns the world-space normal at pos (in world coordinates) on triangle tri of geom, interpolated from the vertex normals
+    Vector get_interpolated_normal(dGeomID geom, const Point& pos, int tri) const;
+    
+    // Fills aabb with the bounds in the same order as dGeomGetAABB: min x, max x, min y, max y, min z, max z
+    void get_aabb(float* aabb) const;
+};
 
 class MeshGameObj : public GameObj {
+  private:
+    boost::shared_ptr<MeshAnimation> _mesh_anim;
+    boost::shared_ptr<CollisionMesh> _coll_mesh;
+  
   protected:
     void near_draw_impl();
   
   public:
     MeshGameObj(const ORE1::ObjType& obj);
+    
+    float get_bounding_radius() const;
+    RenderState get_render_state() const;
 };
 
 #endif
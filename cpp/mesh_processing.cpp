@@ -0,0 +1,492 @@
+/*
+mesh_processing.cpp: Implementation of mesh processing functions.
+These work on plain vertex and triangle arrays on the CPU, before meshes are handed to GL.
+
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <utility>
+
+#include "mesh_processing.h"
+
+// Symmetric 4x4 matrix giving the sum of squared distances from a point to a set of planes
+struct Quadric {
+  double m[10]; // aa ab ac ad bb bc bd cc cd dd
+  
+  Quadric() {
+    std::fill(m, m + 10, 0.0);
+  }
+  
+  void add_plane(double a, double b, double c, double d, double weight) {
+    m[0] += weight*a*a; m[1] += weight*a*b; m[2] += weight*a*c; m[3] += weight*a*d;
+    m[4] += weight*b*b; m[5] += weight*b*c; m[6] += weight*b*d;
+    m[7] += weight*c*c; m[8] += weight*c*d;
+    m[9] += weight*d*d;
+  }
+  
+  Quadric& operator+=(const Quadric& other) {
+    for (unsigned int i = 0; i < 10; ++i) {
+      m[i] += other.m[i];
+    }
+    return *this;
+  }
+  
+  double error(const MeshVertex& p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x
+      + m[4]*y*y + 2*m[5]*y*z + 2*m[6]*y
+      + m[7]*z*z + 2*m[8]*z
+      + m[9];
+  }
+};
+
+// A candidate move of one vertex onto another; the versions detect candidates made stale by later collapses
+struct Collapse {
+  double cost;
+  unsigned int from, to;
+  unsigned int from_version, to_version;
+  
+  bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+void tri_normal(const MeshVertex& a, const MeshVertex& b, const MeshVertex& c, double* n) {
+  double e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+  double e2[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+  n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+  n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+  n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+class Decimator {
+  private:
+    const MeshData& _mesh;
+    std::vector<MeshTriangle> _tris;
+    std::vector<bool> _tri_alive;
+    std::vector<std::vector<unsigned int> > _vert_tris; // May include dead triangles, which are skipped
+    std::vector<Quadric> _quadrics;
+    std::vector<bool> _locked;
+    std::vector<bool> _vert_alive;
+    std::vector<unsigned int> _versions;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > _heap;
+    unsigned int _live_tris;
+    
+    static unsigned int& corner(MeshTriangle& t, unsigned int i) { return i == 0 ? t.a : (i == 1 ? t.b : t.c); }
+    
+    static bool has_vert(const MeshTriangle& t, unsigned int v) { return t.a == v or t.b == v or t.c == v; }
+    
+    void push_collapse(unsigned int from, unsigned int to) {
+      if (_locked[from]) {
+        return;
+      }
+      Quadric q = _quadrics[from];
+      q += _quadrics[to];
+      Collapse c;
+      c.cost = q.error(_mesh.verts[to]);
+      c.from = from;
+      c.to = to;
+      c.from_version = _versions[from];
+      c.to_version = _versions[to];
+      _heap.push(c);
+    }
+    
+    void push_collapses_around(unsigned int v) {
+      for (std::vector<unsigned int>::const_iterator i = _vert_tris[v].begin(); i != _vert_tris[v].end(); ++i) {
+        if (!_tri_alive[*i]) {
+          continue;
+        }
+        MeshTriangle& t = _tris[*i];
+        for (unsigned int k = 0; k < 3; ++k) {
+          unsigned int w = corner(t, k);
+          if (w != v) {
+            push_collapse(v, w);
+            push_collapse(w, v);
+          }
+        }
+      }
+    }
+    
+    // Returns false if moving from onto to would turn any remaining triangle around from over to its back
+    bool collapse_keeps_orientation(unsigned int from, unsigned int to) {
+      bool adjacent = false;
+      for (std::vector<unsigned int>::const_iterator i = _vert_tris[from].begin(); i != _vert_tris[from].end(); ++i) {
+        if (!_tri_alive[*i]) {
+          continue;
+        }
+        const MeshTriangle& t = _tris[*i];
+        if (has_vert(t, to)) {
+          adjacent = true;
+          continue;
+        }
+        
+        double before[3], after[3];
+        tri_normal(_mesh.verts[t.a], _mesh.verts[t.b], _mesh.verts[t.c], before);
+        tri_normal(
+          _mesh.verts[t.a == from ? to : t.a],
+          _mesh.verts[t.b == from ? to : t.b],
+          _mesh.verts[t.c == from ? to : t.c],
+          after
+        );
+        if (before[0]*after[0] + before[1]*after[1] + before[2]*after[2] <= 0) {
+          return false;
+        }
+      }
+      return adjacent;
+    }
+    
+    void collapse(unsigned int from, unsigned int to) {
+      for (std::vector<unsigned int>::const_iterator i = _vert_tris[from].begin(); i != _vert_tris[from].end(); ++i) {
+        if (!_tri_alive[*i]) {
+          continue;
+        }
+        MeshTriangle& t = _tris[*i];
+        if (has_vert(t, to)) {
+          _tri_alive[*i] = false;
+          --_live_tris;
+        } else {
+          for (unsigned int k = 0; k < 3; ++k) {
+            if (corner(t, k) == from) {
+              corner(t, k) = to;
+            }
+          }
+          _vert_tris[to].push_back(*i);
+        }
+      }
+      _vert_tris[from].clear();
+      _vert_alive[from] = false;
+      _quadrics[to] += _quadrics[from];
+      ++_versions[to];
+      push_collapses_around(to);
+    }
+  
+  public:
+    Decimator(const MeshData& mesh) :
+      _mesh(mesh),
+      _tris(mesh.tris),
+      _tri_alive(mesh.tris.size(), true),
+      _vert_tris(mesh.verts.size()),
+      _quadrics(mesh.verts.size()),
+      _locked(mesh.verts.size(), false),
+      _vert_alive(mesh.verts.size(), true),
+      _versions(mesh.verts.size(), 0),
+      _live_tris(mesh.tris.size())
+    {
+      // Each vertex's quadric covers the planes of the triangles around it, weighted by their area
+      std::map<std::pair<unsigned int, unsigned int>, unsigned int> edge_uses;
+      for (unsigned int i = 0; i < _tris.size(); ++i) {
+        MeshTriangle& t = _tris[i];
+        double n[3];
+        tri_normal(_mesh.verts[t.a], _mesh.verts[t.b], _mesh.verts[t.c], n);
+        double len = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        for (unsigned int k = 0; k < 3; ++k) {
+          unsigned int v = corner(t, k);
+          _vert_tris[v].push_back(i);
+          if (len > 0) {
+            const MeshVertex& p = _mesh.verts[t.a];
+            double d = -(n[0]*p.x + n[1]*p.y + n[2]*p.z)/len;
+            _quadrics[v].add_plane(n[0]/len, n[1]/len, n[2]/len, d, len/2);
+          }
+          unsigned int w = corner(t, (k + 1)%3);
+          ++edge_uses[std::make_pair(std::min(v, w), std::max(v, w))];
+        }
+      }
+      
+      // Open edges are the mesh's borders and texture seams; moving their vertices would open cracks
+      for (std::map<std::pair<unsigned int, unsigned int>, unsigned int>::const_iterator i = edge_uses.begin(); i != edge_uses.end(); ++i) {
+        if (i->second == 1) {
+          _locked[i->first.first] = true;
+          _locked[i->first.second] = true;
+        }
+      }
+      
+      for (std::map<std::pair<unsigned int, unsigned int>, unsigned int>::const_iterator i = edge_uses.begin(); i != edge_uses.end(); ++i) {
+        push_collapse(i->first.first, i->first.second);
+        push_collapse(i->first.second, i->first.first);
+      }
+    }
+    
+    MeshData run(unsigned int target_tris) {
+      while (_live_tris > target_tris and !_heap.empty()) {
+        Collapse c = _heap.top();
+        _heap.pop();
+        if (
+          !_vert_alive[c.from] or !_vert_alive[c.to] or
+          c.from_version != _versions[c.from] or c.to_version != _versions[c.to]
+        ) {
+          continue;
+        }
+        if (collapse_keeps_orientation(c.from, c.to)) {
+          collapse(c.from, c.to);
+        }
+      }
+      
+      // Copy out the surviving triangles and the vertices they still use
+      MeshData ret;
+      std::vector<unsigned int> remap(_mesh.verts.size(), std::numeric_limits<unsigned int>::max());
+      for (unsigned int i = 0; i < _tris.size(); ++i) {
+        if (!_tri_alive[i]) {
+          continue;
+        }
+        MeshTriangle t = _tris[i];
+        for (unsigned int k = 0; k < 3; ++k) {
+          unsigned int& v = corner(t, k);
+          if (remap[v] == std::numeric_limits<unsigned int>::max()) {
+            remap[v] = ret.verts.size();
+            ret.verts.push_back(_mesh.verts[v]);
+          }
+          v = remap[v];
+        }
+        ret.tris.push_back(t);
+      }
+      return ret;
+    }
+};
+
+MeshData decimate_mesh(const MeshData& mesh, unsigned int target_tris) {
+  return Decimator(mesh).run(target_tris);
+}
+
+// Cache size assumed while choosing the triangle order; being larger than the real cache costs little
+const unsigned int FORSYTH_CACHE_SIZE = 32;
+
+// Score given to the three most recently used vertices, which are kept slightly below the next few so that
+// the order doesn't keep reusing the last triangle's edge and produce long thin strips
+const float FORSYTH_LAST_TRI_SCORE = 0.75;
+const float FORSYTH_CACHE_DECAY_POWER = 1.5;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.0;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5;
+
+// Orders triangles with Tom Forsyth's linear-speed vertex cache optimisation: repeatedly emits the triangle whose
+// vertices score highest, where a vertex scores more for being recently used and for having few triangles left
+class CacheOptimizer {
+  private:
+    struct VertInfo {
+      int cache_pos; // -1 if not in the modelled cache
+      float score;
+      unsigned int remaining; // Triangles using this vertex which haven't been emitted yet
+      unsigned int first_tri; // Offset of this vertex's triangle list in _vert_tris
+      unsigned int tri_count;
+    };
+    
+    MeshData& _mesh;
+    std::vector<unsigned int> _indices; // Three per triangle
+    std::vector<VertInfo> _verts;
+    std::vector<unsigned int> _vert_tris; // Each vertex's triangles, not yet emitted ones first
+    std::vector<float> _tri_scores;
+    std::vector<bool> _tri_emitted;
+    std::vector<unsigned int> _cache;
+    
+    const unsigned int* tri_indices(unsigned int t) const {
+      return &_indices[t*3];
+    }
+    
+    float vertex_score(const VertInfo& vi) const {
+      if (vi.remaining == 0) {
+        return -1;
+      }
+      
+      float score = 0;
+      if (vi.cache_pos >= 0) {
+        if (vi.cache_pos < 3) {
+          score = FORSYTH_LAST_TRI_SCORE;
+        } else {
+          float scaled = 1.0 - float(vi.cache_pos - 3)/float(FORSYTH_CACHE_SIZE - 3);
+          score = std::pow(scaled, FORSYTH_CACHE_DECAY_POWER);
+        }
+      }
+      return score + FORSYTH_VALENCE_BOOST_SCALE*std::pow(float(vi.remaining), -FORSYTH_VALENCE_BOOST_POWER);
+    }
+    
+    float tri_score(unsigned int t) const {
+      const unsigned int* idx = tri_indices(t);
+      return _verts[idx[0]].score + _verts[idx[1]].score + _verts[idx[2]].score;
+    }
+    
+    // Takes the emitted triangle t out of v's list of remaining triangles
+    void retire_tri(unsigned int v, unsigned int t) {
+      VertInfo& vi = _verts[v];
+      unsigned int* tris = &_vert_tris[vi.first_tri];
+      for (unsigned int i = 0; i < vi.remaining; ++i) {
+        if (tris[i] == t) {
+          std::swap(tris[i], tris[vi.remaining - 1]);
+          --vi.remaining;
+          return;
+        }
+      }
+    }
+  
+  public:
+    CacheOptimizer(MeshData& mesh) : _mesh(mesh) {}
+    
+    void run() {
+      unsigned int tri_count = _mesh.tris.size();
+      _indices.reserve(tri_count*3);
+      for (unsigned int t = 0; t < tri_count; ++t) {
+        _indices.push_back(_mesh.tris[t].a);
+        _indices.push_back(_mesh.tris[t].b);
+        _indices.push_back(_mesh.tris[t].c);
+      }
+      
+      VertInfo blank = { -1, 0, 0, 0, 0 };
+      _verts.assign(_mesh.verts.size(), blank);
+      for (unsigned int t = 0; t < tri_count; ++t) {
+        const unsigned int* idx = tri_indices(t);
+        for (unsigned int i = 0; i < 3; ++i) {
+          ++_verts[idx[i]].tri_count;
+        }
+      }
+      
+      unsigned int offset = 0;
+      for (unsigned int v = 0; v < _verts.size(); ++v) {
+        _verts[v].first_tri = offset;
+        offset += _verts[v].tri_count;
+      }
+      _vert_tris.resize(offset);
+      for (unsigned int t = 0; t < tri_count; ++t) {
+        const unsigned int* idx = tri_indices(t);
+        for (unsigned int i = 0; i < 3; ++i) {
+          VertInfo& vi = _verts[idx[i]];
+          _vert_tris[vi.first_tri + vi.remaining] = t;
+          ++vi.remaining;
+        }
+      }
+      for (unsigned int v = 0; v < _verts.size(); ++v) {
+        _verts[v].score = vertex_score(_verts[v]);
+      }
+      
+      _tri_scores.resize(tri_count);
+      _tri_emitted.assign(tri_count, false);
+      for (unsigned int t = 0; t < tri_count; ++t) {
+        _tri_scores[t] = tri_score(t);
+      }
+      
+      std::vector<MeshTriangle> order;
+      order.reserve(tri_count);
+      unsigned int scan_from = 0; // Every triangle before this has been emitted
+      int best = -1;
+      while (order.size() < tri_count) {
+        if (best < 0) {
+          // Nothing in the cache has triangles left, so start again from the best remaining triangle anywhere
+          while (_tri_emitted[scan_from]) {
+            ++scan_from;
+          }
+          best = scan_from;
+          for (unsigned int t = scan_from + 1; t < tri_count; ++t) {
+            if (!_tri_emitted[t] && _tri_scores[t] > _tri_scores[best]) {
+              best = t;
+            }
+          }
+        }
+        
+        const unsigned int* idx = tri_indices(best);
+        order.push_back(_mesh.tris[best]);
+        _tri_emitted[best] = true;
+        
+        // Move the triangle's vertices to the front of the cache, pushing the rest back
+        std::vector<unsigned int> new_cache(idx, idx + 3);
+        for (unsigned int i = 0; i < 3; ++i) {
+          retire_tri(idx[i], best);
+        }
+        for (unsigned int i = 0; i < _cache.size(); ++i) {
+          unsigned int v = _cache[i];
+          if (v != idx[0] && v != idx[1] && v != idx[2]) {
+            new_cache.push_back(v);
+          }
+        }
+        _cache.swap(new_cache);
+        
+        for (unsigned int i = 0; i < _cache.size(); ++i) {
+          VertInfo& vi = _verts[_cache[i]];
+          vi.cache_pos = i < FORSYTH_CACHE_SIZE ? int(i) : -1;
+          vi.score = vertex_score(vi);
+        }
+        
+        // Rescore the remaining triangles of everything that was in the cache, and pick the next from among them
+        best = -1;
+        for (unsigned int i = 0; i < _cache.size(); ++i) {
+          const VertInfo& vi = _verts[_cache[i]];
+          for (unsigned int j = 0; j < vi.remaining; ++j) {
+            unsigned int t = _vert_tris[vi.first_tri + j];
+            _tri_scores[t] = tri_score(t);
+            if (best < 0 || _tri_scores[t] > _tri_scores[best]) {
+              best = t;
+            }
+          }
+        }
+        
+        if (_cache.size() > FORSYTH_CACHE_SIZE) {
+          _cache.resize(FORSYTH_CACHE_SIZE);
+        }
+      }
+      _mesh.tris.swap(order);
+    }
+};
+
+void optimize_vertex_cache(MeshData& mesh) {
+  CacheOptimizer(mesh).run();
+  
+  // Renumber the vertices in the order the triangles first use them, so vertex fetches walk forward through memory
+  const unsigned int unused = std::numeric_limits<unsigned int>::max();
+  std::vector<unsigned int> remap(mesh.verts.size(), unused);
+  std::vector<MeshVertex> verts;
+  verts.reserve(mesh.verts.size());
+  for (std::vector<MeshTriangle>::iterator t = mesh.tris.begin(); t != mesh.tris.end(); ++t) {
+    unsigned int* idx[3] = { &t->a, &t->b, &t->c };
+    for (unsigned int i = 0; i < 3; ++i) {
+      unsigned int& v = *idx[i];
+      if (remap[v] == unused) {
+        remap[v] = verts.size();
+        verts.push_back(mesh.verts[v]);
+      }
+      v = remap[v];
+    }
+  }
+  
+  // Vertices no triangle refers to are kept at the end rather than dropped, so the vertex count doesn't change
+  for (unsigned int v = 0; v < mesh.verts.size(); ++v) {
+    if (remap[v] == unused) {
+      verts.push_back(mesh.verts[v]);
+    }
+  }
+  mesh.verts.swap(verts);
+}
+
+unsigned int count_cache_misses(const MeshData& mesh, unsigned int cache_size) {
+  std::deque<unsigned int> fifo;
+  unsigned int misses = 0;
+  for (std::vector<MeshTriangle>::const_iterator t = mesh.tris.begin(); t != mesh.tris.end(); ++t) {
+    unsigned int idx[3] = { t->a, t->b, t->c };
+    for (unsigned int i = 0; i < 3; ++i) {
+      if (std::find(fifo.begin(), fifo.end(), idx[i]) == fifo.end()) {
+        ++misses;
+        fifo.push_back(idx[i]);
+        if (fifo.size() > cache_size) {
+          fifo.pop_front();
+        }
+      }
+    }
+  }
+  return misses;
+}
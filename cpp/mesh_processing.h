@@ -0,0 +1,58 @@
+/*
+mesh_processing.h: Header for mesh processing functions.
+These work on plain vertex and triangle arrays on the CPU, before meshes are handed to GL.
+
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#ifndef ORBIT_RIBBON_MESH_PROCESSING_H
+#define ORBIT_RIBBON_MESH_PROCESSING_H
+
+#include <vector>
+
+struct MeshVertex {
+  float x, y, z;
+  float nx, ny, nz;
+  float u, v;
+};
+
+struct MeshTriangle {
+  unsigned int a, b, c;
+};
+
+struct MeshData {
+  std::vector<MeshVertex> verts;
+  std::vector<MeshTriangle> tris;
+};
+
+// Returns a copy of the mesh reduced to at most target_tris triangles, by collapsing the edges whose removal
+// changes the surface least according to their endpoints' quadric error (Garland and Heckbert's method).
+// Each collapse moves one endpoint onto the other, so surviving vertices keep their own normals and texture coordinates.
+// Vertices on open edges, including texture seams, are never moved, so the result may stay above target_tris.
+MeshData decimate_mesh(const MeshData& mesh, unsigned int target_tris);
+
+// Reorders the triangles so that they reuse recently transformed vertices (Forsyth's method), then renumbers
+// the vertices in the order the triangles first reach them. The surface drawn is unchanged.
+void optimize_vertex_cache(MeshData& mesh);
+
+// Simulates a FIFO post-transform cache of the given size over the mesh's triangles, returning how many vertices
+// had to be transformed; divided by the triangle count this is the average cache miss ratio (ACMR)
+unsigned int count_cache_misses(const MeshData& mesh, unsigned int cache_size);
+
+#endif
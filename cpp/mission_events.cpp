@@ -0,0 +1,79 @@
+/*
+mission_events.cpp: Implementation for the MissionEvents class.
+This class collects the events which can cause mission state transition conditions to become true.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <boost/foreach.hpp>
+
+#include "globals.h"
+#include "mission_events.h"
+#include "sim.h"
+
+unsigned int MissionEvents::_pending = 0;
+std::set<unsigned int> MissionEvents::_deadlines;
+std::vector<MissionEvents::AvatarWatch> MissionEvents::_watches;
+
+void MissionEvents::schedule_deadline(unsigned int step) {
+  _deadlines.insert(step > Globals::total_steps ? step : Globals::total_steps + 1);
+}
+
+void MissionEvents::watch_avatar(const Point& center, const Vector& origin, float dist) {
+  BOOST_FOREACH(const AvatarWatch& other, _watches) {
+    if (other.center == center and other.origin == origin and other.dist == dist) {
+      return;
+    }
+  }
+  
+  AvatarWatch w;
+  w.center = center;
+  w.origin = origin;
+  w.dist = dist;
+  _watches.push_back(w);
+}
+
+void MissionEvents::reset() {
+  _pending = 0;
+  _deadlines.clear();
+  _watches.clear();
+}
+
+unsigned int MissionEvents::take(const Point& avatar_pos) {
+  unsigned int events = _pending | MISSION_EVENT_STEP;
+  _pending = 0;
+  
+  while (!_deadlines.empty() and *_deadlines.begin() <= Globals::total_steps) {
+    _deadlines.erase(_deadlines.begin());
+    events |= MISSION_EVENT_DEADLINE;
+  }
+  
+  // Each watch only fires once; the condition that set it up sets up another if it still needs one
+  const Vector& origin = Sim::get_origin_offset();
+  for (std::vector<AvatarWatch>::iterator i = _watches.begin(); i != _watches.end();) {
+    Vector moved = (avatar_pos - i->center) + (origin - i->origin);
+    if (moved.mag() > i->dist) {
+      events |= MISSION_EVENT_AVATAR_MOVED;
+      i = _watches.erase(i);
+    } else {
+      ++i;
+    }
+  }
+  
+  return events;
+}
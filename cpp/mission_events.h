@@ -0,0 +1,74 @@
+/*
+mission_events.h: Header for the MissionEvents class.
+This class collects the events which can cause mission state transition conditions to become true.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#ifndef ORBIT_RIBBON_MISSION_EVENTS_H
+#define ORBIT_RIBBON_MISSION_EVENTS_H
+
+#include <set>
+#include <vector>
+
+#include "geometry.h"
+
+class MissionFSM;
+
+// Bits for each kind of event; conditions say which ones they listen for, and are only checked after one of those fires
+const unsigned int MISSION_EVENT_STEP = 1; // Fired on every step, for conditions that have to be polled
+const unsigned int MISSION_EVENT_RING_PASSED = 2; // A target ring was passed, or un-passed by a snapshot restore
+const unsigned int MISSION_EVENT_DEADLINE = 4; // A step scheduled with schedule_deadline has been reached
+const unsigned int MISSION_EVENT_AVATAR_MOVED = 8; // The avatar left a region given to watch_avatar
+const unsigned int MISSION_EVENT_ALL = ~0u;
+
+class MissionEvents {
+  public:
+    static void fire(unsigned int events) { _pending |= events; }
+    
+    // Fires MISSION_EVENT_DEADLINE on the given step; asking for a step that has already begun fires it on the next one
+    // Conditions ask again every time they're rechecked, so asking for an already scheduled step does nothing.
+    static void schedule_deadline(unsigned int step);
+    
+    // Fires MISSION_EVENT_AVATAR_MOVED once the avatar gets further than dist from center
+    // The center is a simulation position as of when the simulation origin was at origin. As with deadlines, setting up
+    // the same watch again while it's still pending does nothing.
+    static void watch_avatar(const Point& center, const Vector& origin, float dist);
+  
+  private:
+    friend class MissionFSM;
+    
+    // Watched regions are kept relative to the simulation origin as it was when they were set up
+    struct AvatarWatch {
+      Point center;
+      Vector origin;
+      float dist;
+    };
+    
+    static unsigned int _pending;
+    static std::set<unsigned int> _deadlines;
+    static std::vector<AvatarWatch> _watches;
+    
+    // Drops all deadlines and watches, which are only meaningful to the conditions of the state that set them up
+    static void reset();
+    
+    // Returns everything fired since the last call, including deadlines reached as of now and watches the avatar has left
+    static unsigned int take(const Point& avatar_pos);
+};
+
+#endif
@@ -23,11 +23,13 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include <boost/foreach.hpp>
 
 #include "autoxsd/orepkgdesc.h"
+#include "avatar.h"
 #include "debug.h"
 #include "except.h"
 #include "gameplay_mode.h"
 #include "globals.h"
 #include "simple_menu_modes.h"
+#include "snapshot.h"
 
 #include "mission_fsm.h"
 
@@ -40,14 +42,30 @@ MissionStateTransitionCondition::MissionStateTransitionCondition(const ORE1::Mis
 }
 
 MissionStateTransition::MissionStateTransition(const ORE1::MissionStateTransitionType& transition) :
-  _target_name(transition.target())
+  _target_name(transition.target()),
+  _target(MISSION_STATE_NONE),
+  _events(0)
 {
   ORE1::MissionStateTransitionType::cond_const_iterator i;
   for (i = transition.cond().begin(); i != transition.cond().end(); ++i) {
     _conditions.push_back(get_factory<MissionStateTransitionConditionFactorySpec>().create(*i));
+    _events |= _conditions.back()->get_events();
+  }
+  
+  // A transition with no conditions is taken as soon as the state is entered
+  if (_conditions.empty()) {
+    _events = MISSION_EVENT_ALL;
   }
 }
 
+void MissionStateTransition::resolve_target(const MissionStateIdMap& ids) {
+  MissionStateIdMap::const_iterator i = ids.find(_target_name);
+  if (i == ids.end()) {
+    throw GameException("No such mission state \"" + _target_name + "\"");
+  }
+  _target = i->second;
+}
+
 bool MissionStateTransition::conditions_true(const GameplayMode& gameplay_mode) const {
  BOOST_FOREACH(const boost::shared_ptr<MissionStateTransitionCondition>& _cond, _conditions) {
    if (!_cond->is_true(gameplay_mode)) {
@@ -63,7 +81,28 @@ void MissionStateTransition::draw(const GameplayMode& gameplay_mode) {
   }
 }
 
-MissionState::MissionState(const ORE1::MissionStateType& state) {
+void MissionStateTransition::reset() {
+  BOOST_FOREACH(const boost::shared_ptr<MissionStateTransitionCondition>& _cond, _conditions) {
+    _cond->reset();
+  }
+}
+
+void MissionStateTransition::save_state(SnapshotBuffer& buf) const {
+  BOOST_FOREACH(const boost::shared_ptr<MissionStateTransitionCondition>& _cond, _conditions) {
+    _cond->save_state(buf);
+  }
+}
+
+void MissionStateTransition::restore_state(SnapshotBuffer& buf) {
+  BOOST_FOREACH(const boost::shared_ptr<MissionStateTransitionCondition>& _cond, _conditions) {
+    _cond->restore_state(buf);
+  }
+}
+
+MissionState::MissionState(const ORE1::MissionStateType& state) :
+  _name(state.name()),
+  _entering_msg("Entering mission state \"" + state.name() + "\"")
+{
   ORE1::MissionStateType::effect_const_iterator i;
   for (i = state.effect().begin(); i != state.effect().end(); ++i) {
     _effects.push_back(get_factory<MissionEffectFactorySpec>().create(*i));
@@ -75,16 +114,25 @@ MissionState::MissionState(const ORE1::MissionStateType& state) {
   }
 }
 
-std::string MissionState::get_transition(const GameplayMode& gameplay_mode) {
+void MissionState::resolve_targets(const MissionStateIdMap& ids) {
+  BOOST_FOREACH(MissionStateTransition& transition, _transitions) {
+    transition.resolve_target(ids);
+  }
+}
+
+int MissionState::get_transition(const GameplayMode& gameplay_mode, unsigned int events) {
   BOOST_FOREACH(const MissionStateTransition& transition, _transitions) {
-    if (transition.conditions_true(gameplay_mode)) {
-      return transition.get_target_name();
+    if ((transition.get_events() & events) and transition.conditions_true(gameplay_mode)) {
+      return transition.get_target();
     }
   }
-  return "";
+  return MISSION_STATE_NONE;
 }
 
 void MissionState::entering_state(const GameplayMode& gameplay_mode) {
+  BOOST_FOREACH(MissionStateTransition& transition, _transitions) {
+    transition.reset();
+  }
   BOOST_FOREACH(const boost::shared_ptr<MissionEffect>& effect, _effects) {
     effect->entering_state(gameplay_mode);
   }
@@ -111,33 +159,78 @@ void MissionState::draw(const GameplayMode& gameplay_mode) {
   }
 }
 
-void MissionFSM::transition_to_state(const std::string& name) { 
-  Debug::status_msg("Entering mission state \"" + name + "\"");
+void MissionState::save_state(SnapshotBuffer& buf) const {
+  BOOST_FOREACH(const MissionStateTransition& transition, _transitions) {
+    transition.save_state(buf);
+  }
+}
 
-  if (_cur_state.get() != NULL) {
-    _cur_state->exiting_state(_gameplay_mode);
+void MissionState::restore_state(SnapshotBuffer& buf) {
+  BOOST_FOREACH(MissionStateTransition& transition, _transitions) {
+    transition.restore_state(buf);
   }
+}
 
-  if (name == "win" or name == "fail") {
-    _finished = true;
-    Globals::mode_stack->next_frame_push_mode(boost::shared_ptr<Mode>(new PostMissionMenuMode(name == "win")));
-    return;
+const std::string& MissionFSM::get_state_name(int id) const {
+  static const std::string none;
+  static const std::string win("win");
+  static const std::string fail("fail");
+  if (id == MISSION_STATE_WIN) {
+    return win;
+  } else if (id == MISSION_STATE_FAIL) {
+    return fail;
+  } else if (id >= 0 and id < int(_states.size())) {
+    return _states[id]->get_name();
   }
+  return none;
+}
 
-  ORE1::MissionType::state_const_iterator i;
-  for (i = _mission.state().begin(); i != _mission.state().end(); ++i) {
-    if (i->name() == name) { break; }
+void MissionFSM::transition_to_state(int id) {
+  if (_cur_state != MISSION_STATE_NONE) {
+    _states[_cur_state]->exiting_state(_gameplay_mode);
   }
-  if (i == _mission.state().end()) {
-    throw GameException("No such mission state \"" + name + "\"");
+
+  if (id == MISSION_STATE_WIN or id == MISSION_STATE_FAIL) {
+    Debug::status_msg("Entering mission state \"" + get_state_name(id) + "\"");
+    _finished = true;
+    Globals::mode_stack->next_frame_push_mode(boost::shared_ptr<Mode>(new PostMissionMenuMode(id == MISSION_STATE_WIN)));
+    return;
   }
-  _cur_state.reset(new MissionState(*i));
-  _cur_state->entering_state(_gameplay_mode); 
+
+  // The new state's conditions all get checked on the next step, and set up whatever events they need then
+  MissionEvents::reset();
+  MissionEvents::fire(MISSION_EVENT_ALL);
+  
+  _cur_state = id;
+  Debug::status_msg(_states[id]->get_entering_msg());
+  _states[id]->entering_state(_gameplay_mode);
 }
 
 MissionFSM::MissionFSM(const ORE1::MissionType& mission, const GameplayMode& gameplay_mode) :
-  _mission(mission), _gameplay_mode(gameplay_mode), _cur_state(NULL), _finished(false)
+  _gameplay_mode(gameplay_mode), _start_state(MISSION_STATE_NONE), _cur_state(MISSION_STATE_NONE), _finished(false)
 {
+  // Number the states first, since transitions can point forward to states that haven't been built yet
+  MissionStateIdMap ids;
+  ids["win"] = MISSION_STATE_WIN;
+  ids["fail"] = MISSION_STATE_FAIL;
+  for (ORE1::MissionType::state_const_iterator i = mission.state().begin(); i != mission.state().end(); ++i) {
+    if (!ids.insert(MissionStateIdMap::value_type(i->name(), _states.size())).second) {
+      throw GameException("Duplicate mission state \"" + i->name() + "\"");
+    }
+    _states.push_back(boost::shared_ptr<MissionState>(new MissionState(*i)));
+  }
+  
+  BOOST_FOREACH(const boost::shared_ptr<MissionState>& state, _states) {
+    state->resolve_targets(ids);
+  }
+  
+  MissionStateIdMap::const_iterator start = ids.find("start");
+  if (start == ids.end() or start->second < 0) {
+    throw GameException("No such mission state \"start\"");
+  }
+  _start_state = start->second;
+  
+  MissionEvents::reset();
 }
 
 void MissionFSM::step() {
@@ -145,22 +238,49 @@ void MissionFSM::step() {
     return;
   }
 
-  if (_cur_state.get() == NULL) {
-    transition_to_state("start");
+  if (_cur_state == MISSION_STATE_NONE) {
+    transition_to_state(_start_state);
   }
   
-  _cur_state->step(_gameplay_mode);
+  unsigned int events = MissionEvents::take(_gameplay_mode.find_avatar()->get_pos());
+  MissionState& state = *_states[_cur_state];
+  state.step(_gameplay_mode);
   
-  std::string transition_target = _cur_state->get_transition(_gameplay_mode);
-  if (transition_target.size() > 0) {
+  int transition_target = state.get_transition(_gameplay_mode, events);
+  if (transition_target != MISSION_STATE_NONE) {
     transition_to_state(transition_target);
   }
 }
 
+void MissionFSM::save_state(SnapshotBuffer& buf) const {
+  buf.write(_finished);
+  buf.write(_cur_state);
+  if (_cur_state != MISSION_STATE_NONE) {
+    _states[_cur_state]->save_state(buf);
+  }
+}
+
+void MissionFSM::restore_state(SnapshotBuffer& buf) {
+  buf.read(_finished);
+  buf.read(_cur_state);
+  
+  // Pending deadlines and watches belong to the abandoned timeline; checking everything sets up new ones
+  MissionEvents::reset();
+  MissionEvents::fire(MISSION_EVENT_ALL);
+  
+  // A snapshot taken before the first step has no state, and the start state will be entered normally on the next one
+  if (_cur_state != MISSION_STATE_NONE) {
+    if (_cur_state < 0 or _cur_state >= int(_states.size())) {
+      throw GameException("World snapshot has an invalid mission state");
+    }
+    _states[_cur_state]->restore_state(buf);
+  }
+}
+
 void MissionFSM::draw() {
-  if (_cur_state.get() == NULL) {
-    transition_to_state("start");
+  if (_cur_state == MISSION_STATE_NONE) {
+    transition_to_state(_start_state);
   }
   
-  _cur_state->draw(_gameplay_mode);
+  _states[_cur_state]->draw(_gameplay_mode);
 }
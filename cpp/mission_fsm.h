@@ -23,16 +23,17 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #ifndef ORBIT_RIBBON_MISSION_FSM_H
 #define ORBIT_RIBBON_MISSION_FSM_H
 
-#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
-#include <list>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "factory.h"
+#include "mission_events.h"
 
 class GameplayMode;
+class SnapshotBuffer;
 
 namespace ORE1 {
   class MissionStateType;
@@ -42,6 +43,11 @@ namespace ORE1 {
   class MissionEffectType;
 }
 
+// Mission states are numbered by their position in the mission when it's loaded; these ids are for everything else
+const int MISSION_STATE_NONE = -1;
+const int MISSION_STATE_WIN = -2;
+const int MISSION_STATE_FAIL = -3;
+
 class MissionEffect {
   public:
     MissionEffect(const ORE1::MissionEffectType& effect);
@@ -65,56 +71,105 @@ class MissionStateTransitionCondition {
   public:
     MissionStateTransitionCondition(const ORE1::MissionConditionType& condition);
     virtual bool is_true(const GameplayMode& gameplay_mode) =0;
+    
+    // The MISSION_EVENT_* bits for events that might make this condition true
+    // Conditions that can only become true through something they've arranged with MissionEvents should ask for
+    // it again every time is_true returns false.
+    virtual unsigned int get_events() const { return MISSION_EVENT_STEP; }
+    
     void draw(const GameplayMode& gameplay_mode) { if (_display) draw_impl(gameplay_mode); }
+    
+    // Conditions live as long as the mission, so any progress they track has to be forgotten when their state is re-entered
+    virtual void reset() {}
+    
+    // Conditions which track progress between steps must save and restore it for world snapshots
+    virtual void save_state(SnapshotBuffer& buf __attribute__ ((unused))) const {}
+    virtual void restore_state(SnapshotBuffer& buf __attribute__ ((unused))) {}
 };
 
 class MissionStateTransitionConditionFactorySpec :
   public FactorySpecBase<MissionStateTransitionCondition, ORE1::MissionConditionType> {};
 
+typedef std::map<std::string, int> MissionStateIdMap;
+
 class MissionStateTransition {
   private:
-    typedef std::list<boost::shared_ptr<MissionStateTransitionCondition> > ConditionList;
+    typedef std::vector<boost::shared_ptr<MissionStateTransitionCondition> > ConditionList;
     ConditionList _conditions;
     std::string _target_name;
+    int _target;
+    unsigned int _events;
   
   public:
     MissionStateTransition(const ORE1::MissionStateTransitionType& transition);
     
-    std::string get_target_name() const { return _target_name; }
+    // Looks up the target state's id; has to be done once all the mission's states are numbered
+    void resolve_target(const MissionStateIdMap& ids);
+    
+    int get_target() const { return _target; }
+    unsigned int get_events() const { return _events; }
     bool conditions_true(const GameplayMode& gameplay_mode) const;
     void draw(const GameplayMode& gameplay_mode);
+    void reset();
+    
+    void save_state(SnapshotBuffer& buf) const;
+    void restore_state(SnapshotBuffer& buf);
 };
 
-class MissionState {
+class MissionState : boost::noncopyable {
   private:
-    typedef std::list<boost::shared_ptr<MissionEffect> > EffectList;
+    typedef std::vector<boost::shared_ptr<MissionEffect> > EffectList;
     EffectList _effects;
-    std::list<MissionStateTransition> _transitions;
+    std::vector<MissionStateTransition> _transitions;
+    std::string _name;
+    std::string _entering_msg;
   
   public:
     MissionState(const ORE1::MissionStateType& state);
+    void resolve_targets(const MissionStateIdMap& ids);
+    
+    const std::string& get_name() const { return _name; }
+    const std::string& get_entering_msg() const { return _entering_msg; }
     
-    std::string get_transition(const GameplayMode& gameplay_mode);
+    // Returns the id of the state to go to, or MISSION_STATE_NONE to stay in this one
+    // Only transitions with a condition listening for one of the given events are checked.
+    int get_transition(const GameplayMode& gameplay_mode, unsigned int events);
     
     virtual void entering_state(const GameplayMode& gameplay_mode);
     virtual void step(const GameplayMode& gameplay_mode);
     virtual void exiting_state(const GameplayMode& gameplay_mode);
     virtual void draw(const GameplayMode& gameplay_mode);
+    
+    void save_state(SnapshotBuffer& buf) const;
+    void restore_state(SnapshotBuffer& buf);
 };
 
+// Every state of the mission is built when the FSM is constructed, with transition targets resolved to state ids
+// Changing state after that only changes which entry of the table is current.
 class MissionFSM : boost::noncopyable {
   private:
-    const ORE1::MissionType& _mission;
     const GameplayMode& _gameplay_mode;
-    boost::scoped_ptr<MissionState> _cur_state;
+    std::vector<boost::shared_ptr<MissionState> > _states;
+    int _start_state;
+    int _cur_state;
     bool _finished;
     
-    void transition_to_state(const std::string& name);
+    void transition_to_state(int id);
   
   public:
     MissionFSM(const ORE1::MissionType& mission, const GameplayMode& gameplay_mode);
     void step();
     void draw();
+    
+    // The current state is MISSION_STATE_NONE until the start state is entered on the first step or draw
+    int get_state_id() const { return _cur_state; }
+    int get_start_state_id() const { return _start_state; }
+    const std::string& get_state_name(int id) const;
+    bool is_finished() const { return _finished; }
+    
+    // Restoring puts the FSM back into the saved state directly, without running any effects' entering_state
+    void save_state(SnapshotBuffer& buf) const;
+    void restore_state(SnapshotBuffer& buf);
 };
 
 #endif
@@ -26,13 +26,16 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include "avatar.h"
 #include "constants.h"
 #include "font.h"
+#include "gameobj.h"
 #include "gameplay_mode.h"
 #include "globals.h"
-
-#include "target_ring.h"
+#include "mission_events.h"
+#include "sim.h"
+#include "snapshot.h"
 
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
+#include <cmath>
 
 const float AVATAR_MOVES_CONDITION_DISTANCE = 1.5;
 
@@ -43,16 +46,7 @@ AutoRegistrationBySourceTypename<
 > rings_passed_condition_reg;
 
 unsigned int RingsPassedCondition::passed_rings() const {
-  unsigned int ret = 0;
-  for (GOMap::iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
-    GOMap::size_type idx = i->first.find("LIBTargetRing");
-    if (idx == 0) {
-      if (static_cast<const TargetRingGameObj*>(&*(i->second))->passed()) {
-        ++ret;
-      }
-    }
-  }
-  return ret;
+  return GameObjRegistry::get_counter(GameObjRegistry::RINGS_PASSED);
 }
 
 RingsPassedCondition::RingsPassedCondition(const ORE1::RingsPassedConditionType& condition) :
@@ -101,7 +95,28 @@ bool TimerCountdownCondition::is_true(const GameplayMode& gameplay_mode __attrib
     _started = true;
   }
   
-  return elapsed_nanvi() > _nanvi;
+  if (elapsed_nanvi() > _nanvi) {
+    return true;
+  }
+  
+  // If rounding makes this a step early, the deadline is just asked for again and lands on the next step
+  MissionEvents::schedule_deadline(_steps_at_start + (unsigned int)std::floor(_nanvi*float(MAX_FPS)/NANVI_PER_SECOND) + 1);
+  return false;
+}
+
+void TimerCountdownCondition::reset() {
+  _steps_at_start = 0;
+  _started = false;
+}
+
+void TimerCountdownCondition::save_state(SnapshotBuffer& buf) const {
+  buf.write(_steps_at_start);
+  buf.write(_started);
+}
+
+void TimerCountdownCondition::restore_state(SnapshotBuffer& buf) {
+  buf.read(_steps_at_start);
+  buf.read(_started);
 }
 
 AutoRegistrationBySourceTypename<
@@ -119,7 +134,32 @@ AvatarMovesCondition::AvatarMovesCondition(const ORE1::AvatarMovesConditionType&
 bool AvatarMovesCondition::is_true(const GameplayMode& gameplay_mode) {
   if (!_started) {
     _starting_pos = gameplay_mode.find_avatar()->get_pos();
+    _starting_origin = Sim::get_origin_offset();
     _started = true;
   }
-  return gameplay_mode.find_avatar()->get_pos().dist_to(_starting_pos) > AVATAR_MOVES_CONDITION_DISTANCE;
+  
+  // The simulation origin may have moved since the start; origin offsets are exact so this doesn't lose precision
+  Vector moved = (gameplay_mode.find_avatar()->get_pos() - _starting_pos) + (Sim::get_origin_offset() - _starting_origin);
+  if (moved.mag() > AVATAR_MOVES_CONDITION_DISTANCE) {
+    return true;
+  }
+  
+  MissionEvents::watch_avatar(_starting_pos, _starting_origin, AVATAR_MOVES_CONDITION_DISTANCE);
+  return false;
+}
+
+void AvatarMovesCondition::reset() {
+  _started = false;
+}
+
+void AvatarMovesCondition::save_state(SnapshotBuffer& buf) const {
+  buf.write(_starting_pos);
+  buf.write(_starting_origin);
+  buf.write(_started);
+}
+
+void AvatarMovesCondition::restore_state(SnapshotBuffer& buf) {
+  buf.read(_starting_pos);
+  buf.read(_starting_origin);
+  buf.read(_started);
 }
@@ -37,6 +37,7 @@ class RingsPassedCondition : public MissionStateTransitionCondition {
     RingsPassedCondition(const ORE1::RingsPassedConditionType& condition);
     void draw_impl(const GameplayMode& gameplay_mode);
     bool is_true(const GameplayMode& gameplay_mode);
+    unsigned int get_events() const { return MISSION_EVENT_RING_PASSED; }
 };
 
 namespace ORE1 { class TimerCountdownConditionType; }
@@ -52,17 +53,26 @@ class TimerCountdownCondition : public MissionStateTransitionCondition {
     TimerCountdownCondition(const ORE1::TimerCountdownConditionType& condition);
     void draw_impl(const GameplayMode& gameplay_mode);
     bool is_true(const GameplayMode& gameplay_mode);
+    unsigned int get_events() const { return MISSION_EVENT_DEADLINE; }
+    void reset();
+    void save_state(SnapshotBuffer& buf) const;
+    void restore_state(SnapshotBuffer& buf);
 };
 
 namespace ORE1 { class AvatarMovesConditionType; }
 class AvatarMovesCondition : public MissionStateTransitionCondition {
   private:
     Point _starting_pos;
+    Vector _starting_origin;
     bool _started;
 
   public:
     AvatarMovesCondition(const ORE1::AvatarMovesConditionType& condition);
     bool is_true(const GameplayMode& gameplay_mode);
+    unsigned int get_events() const { return MISSION_EVENT_AVATAR_MOVED; }
+    void reset();
+    void save_state(SnapshotBuffer& buf) const;
+    void restore_state(SnapshotBuffer& buf);
 };
 
 #endif
@@ -22,11 +22,17 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 
 #include "mode.h"
 
+#include "background.h"
 #include "constants.h"
 #include "display.h"
 #include "except.h"
 #include "globals.h"
+#include "gui.h"
+#include "mesh.h"
 #include "mouse_cursor.h"
+#include "recording.h"
+#include "render_queue.h"
+#include "rewind.h"
 #include "sim.h"
 
 void ModeStack::PushOperation::apply(ModeStack& mode_stack) {
@@ -81,8 +87,13 @@ void ModeStack::execute_simulation_phase(unsigned int steps_elapsed) {
   if (cur_mode.mode->simulation_enabled()) {
     // Do a simulation step for each realtime tick elapsed
     for (; steps_elapsed > 0; --steps_elapsed) {
+      Recording::step();
+      if (Rewind::step()) {
+        continue;
+      }
       cur_mode.mode->step();
       Sim::sim_step();
+      Rewind::capture();
     }
     return;
   }
@@ -98,6 +109,10 @@ void ModeStack::execute_camera_phase(bool top) {
   const GLOOCamera* cam = cur_mode.mode->get_camera(top);
   if (cam) {
     cam->setup();
+    // The background needs the camera's orientation without its position, for things that are infinitely far away
+    Globals::bg->set_view(cam->tgt - cam->pos, cam->up);
+    // Every mode's 3D drawing sorts and picks levels of detail relative to this
+    RenderQueue::set_eye(cam->pos);
   } else if (!_stack.empty()) {
     // Descend recursively until we get a camera or hit stack bottom
     execute_camera_phase(false);
@@ -106,7 +121,7 @@ void ModeStack::execute_camera_phase(bool top) {
 
 void ModeStack::execute_draw_phase(bool top) {
   PoppedModeStackItem cur_mode(*this);
-    
+  
   if (cur_mode.mode->execute_after_lower_mode() && !_stack.empty()) {
     // Descend recursively if this mode wants the prior mode ran first
     execute_draw_phase(false);
@@ -118,7 +133,7 @@ void ModeStack::execute_draw_phase(bool top) {
   // Projection mode for distant objects
   glMatrixMode(GL_PROJECTION);
   glLoadIdentity();
-  gluPerspective(FOV, Display::get_screen_ratio(), 1000, SKY_CLIP_DIST);
+  gluPerspective(FOV, Display::get_screen_ratio(), SKY_NEAR_DIST, SKY_CLIP_DIST);
   glMatrixMode(GL_MODELVIEW);
   
   cur_mode.mode->draw_3d_far(top);
@@ -141,6 +156,7 @@ void ModeStack::execute_draw_phase(bool top) {
   glLoadIdentity();
   
   cur_mode.mode->draw_2d(top);
+  GUI::Batch::flush();
   
   // The top mode gets to decide if the mouse cursor is drawn
   if (top) {
@@ -168,6 +184,8 @@ void ModeStack::execute_frame(unsigned int steps_elapsed) {
     execute_input_handling_phase();
     execute_simulation_phase(steps_elapsed);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GUI::Batch::new_frame();
+    MeshAnimation::new_frame();
     execute_camera_phase(true);
     execute_draw_phase(true);
   }
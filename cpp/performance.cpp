@@ -24,7 +24,12 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include <deque>
 
 #include "constants.h"
+#include "gui.h"
+#include "mesh.h"
 #include "performance.h"
+#include "rewind.h"
+#include "sim.h"
+#include "streaming.h"
 
 // How many ticks into the past performance are analyzed
 const unsigned int PERF_TICKS_WINDOW = 1000;
@@ -37,6 +42,24 @@ struct FrameInfo {
 
 std::deque<FrameInfo> frames;
 
+// Culling results from the most recent frame
+unsigned int last_near_drawn = 0, last_far_drawn = 0, last_culled = 0;
+
+// RenderQueue results from the most recent frame
+unsigned int last_draw_calls = 0, last_state_changes = 0, last_unsorted_state_changes = 0;
+
+void Performance::record_batching(unsigned int draw_calls, unsigned int state_changes, unsigned int unsorted_state_changes) {
+  last_draw_calls = draw_calls;
+  last_state_changes = state_changes;
+  last_unsorted_state_changes = unsorted_state_changes;
+}
+
+void Performance::record_culling(unsigned int near_drawn, unsigned int far_drawn, unsigned int culled) {
+  last_near_drawn = near_drawn;
+  last_far_drawn = far_drawn;
+  last_culled = culled;
+}
+
 void Performance::record_frame(unsigned int total_ticks, unsigned int idle_ticks) {
   frames.push_back(FrameInfo(total_ticks, idle_ticks));
   
@@ -68,8 +91,49 @@ std::string Performance::get_perf_info() {
     return std::string("CALCULATING FPS...   ");
   }
   
-  return (boost::format("FPS:%4.2f IDLE:%4.2f%%")
+  std::string info = (boost::format("FPS:%4.2f IDLE:%4.2f%%")
     % (frames.size()*1000/float(sum_t))
     % (float(sum_i*100)/float(sum_t))
   ).str();
+  
+  if (GUI::Batch::get_shape_count() > 0) {
+    info += (boost::format(" GUI:%u/%u GL:%u/%u")
+      % GUI::Batch::get_draw_call_count() % GUI::Batch::get_shape_count()
+      % GUI::Batch::get_gl_call_count() % GUI::Batch::get_unbatched_gl_call_count()
+    ).str();
+  }
+  
+  if (Rewind::get_bytes_used() > 0) {
+    info += (boost::format(" RWND:%.1fs %uK/%uK")
+      % Rewind::get_seconds_stored()
+      % (Rewind::get_bytes_used()/1024)
+      % (Rewind::get_bytes_reserved()/1024)
+    ).str();
+  }
+  
+  if (last_near_drawn + last_far_drawn + last_culled > 0) {
+    info += (boost::format(" DRAW:%u+%u CULL:%u") % last_near_drawn % last_far_drawn % last_culled).str();
+  }
+  
+  if (last_draw_calls > 0) {
+    info += (boost::format(" STATE:%u(%u)") % last_state_changes % last_unsorted_state_changes).str();
+  }
+  
+  if (MeshAnimation::get_tris_drawn() > 0) {
+    info += (boost::format(" TRI:%uK(-%uK)")
+      % (MeshAnimation::get_tris_drawn()/1000)
+      % (MeshAnimation::get_tris_saved()/1000)
+    ).str();
+  }
+  
+  if (Streaming::get_cell_count() > 0) {
+    info += (boost::format(" STRM:%u/%u") % Streaming::get_resident_cell_count() % Streaming::get_cell_count()).str();
+  }
+  
+  // This should stop growing once the busiest steps have been seen, after which contacts are stored without allocating
+  if (Sim::get_contact_arena().get_pages_allocated() > 0) {
+    info += (boost::format(" CPAGE:%u") % Sim::get_contact_arena().get_pages_allocated()).str();
+  }
+  
+  return info;
 }
@@ -34,6 +34,12 @@ class Performance {
   
   public:
     static std::string get_perf_info();
+    
+    // Called each frame by modes that cull GameObjs, with how many were drawn in each projection and how many were skipped
+    static void record_culling(unsigned int near_drawn, unsigned int far_drawn, unsigned int culled);
+    
+    // Called each frame with the totals across that frame's RenderQueue flushes
+    static void record_batching(unsigned int draw_calls, unsigned int state_changes, unsigned int unsorted_state_changes);
 };
 
 #endif
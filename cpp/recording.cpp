@@ -0,0 +1,277 @@
+/*
+recording.cpp: Implementation for the Recording class.
+This class records the state of the input channels on every simulation step, and replays those recordings.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <SDL/SDL.h>
+#include <cstring>
+
+#include "autoxsd/orepkgdesc.h"
+#include "autoxsd/save.h"
+#include "debug.h"
+#include "except.h"
+#include "globals.h"
+#include "input.h"
+#include "recording.h"
+#include "saving.h"
+
+// Identifies the file type and format version at the start of every recording
+const char RECORDING_MAGIC[] = "ORREC2";
+const unsigned int RECORDING_MAGIC_LEN = 6;
+
+// The largest number of steps that a single run-length encoded snapshot can cover
+const unsigned int MAX_STEP_REPEATS = 0xFFFF;
+
+// Bits in the flags byte stored for each channel
+const unsigned char CHANNEL_FLAG_ON = 1;
+const unsigned char CHANNEL_FLAG_PARTIALLY_ON = 2;
+const unsigned char CHANNEL_FLAG_FRAME_MATCH = 4;
+
+// The actions whose channels are recorded, in the order they appear in each snapshot
+// New actions must go at the end of these lists, or old recordings will no longer replay correctly
+const ORSave::AxisBoundAction::value_type RECORDED_AXES[] = {
+  ORSave::AxisBoundAction::TranslateX,
+  ORSave::AxisBoundAction::TranslateY,
+  ORSave::AxisBoundAction::TranslateZ,
+  ORSave::AxisBoundAction::RotateX,
+  ORSave::AxisBoundAction::RotateY,
+  ORSave::AxisBoundAction::RotateZ,
+  ORSave::AxisBoundAction::UIX,
+  ORSave::AxisBoundAction::UIY
+};
+const unsigned int RECORDED_AXES_COUNT = sizeof(RECORDED_AXES)/sizeof(RECORDED_AXES[0]);
+
+const ORSave::ButtonBoundAction::value_type RECORDED_BUTTONS[] = {
+  ORSave::ButtonBoundAction::OrientForward,
+  ORSave::ButtonBoundAction::Pause,
+  ORSave::ButtonBoundAction::ResetNeutral,
+  ORSave::ButtonBoundAction::Confirm,
+  ORSave::ButtonBoundAction::Cancel,
+  ORSave::ButtonBoundAction::Rewind
+};
+const unsigned int RECORDED_BUTTONS_COUNT = sizeof(RECORDED_BUTTONS)/sizeof(RECORDED_BUTTONS[0]);
+
+// Each axis takes up a float value and a flags byte, and each button just a flags byte
+const unsigned int STEP_SNAPSHOT_LEN = RECORDED_AXES_COUNT*5 + RECORDED_BUTTONS_COUNT;
+
+boost::filesystem::path Recording::_record_path;
+boost::scoped_ptr<std::ofstream> Recording::_out;
+boost::scoped_ptr<std::ifstream> Recording::_in;
+bool Recording::_max_speed = false;
+std::string Recording::_replay_ore_path;
+unsigned int Recording::_replay_area = 0;
+unsigned int Recording::_replay_mission = 0;
+std::string Recording::_cur_step;
+unsigned int Recording::_cur_step_repeats = 0;
+unsigned int Recording::_steps = 0;
+unsigned int Recording::_start_ticks = 0;
+
+// Integers are always stored little-endian, so that recordings can be moved between machines
+void write_uint(std::ostream& os, unsigned int v, unsigned int bytes) {
+  for (unsigned int i = 0; i < bytes; ++i) {
+    os.put((char)((v >> (i*8)) & 0xFF));
+  }
+}
+
+unsigned int read_uint(std::istream& is, unsigned int bytes) {
+  unsigned int v = 0;
+  for (unsigned int i = 0; i < bytes; ++i) {
+    v |= ((unsigned int)(unsigned char)is.get()) << (i*8);
+  }
+  return v;
+}
+
+void write_float(std::string& s, float f) {
+  Uint32 bits;
+  std::memcpy(&bits, &f, 4);
+  for (unsigned int i = 0; i < 4; ++i) {
+    s.push_back((char)((bits >> (i*8)) & 0xFF));
+  }
+}
+
+float read_float(const std::string& s, unsigned int pos) {
+  Uint32 bits = 0;
+  for (unsigned int i = 0; i < 4; ++i) {
+    bits |= ((Uint32)(unsigned char)s[pos + i]) << (i*8);
+  }
+  float f;
+  std::memcpy(&f, &bits, 4);
+  return f;
+}
+
+unsigned char channel_flags(const Channel& chn) {
+  unsigned char flags = 0;
+  if (chn.is_on()) { flags |= CHANNEL_FLAG_ON; }
+  if (chn.is_partially_on()) { flags |= CHANNEL_FLAG_PARTIALLY_ON; }
+  if (chn.matches_frame_events()) { flags |= CHANNEL_FLAG_FRAME_MATCH; }
+  return flags;
+}
+
+void Recording::start_replay(const boost::filesystem::path& path, bool max_speed) {
+  _in.reset(new std::ifstream(path.string().c_str(), std::ios::in | std::ios::binary));
+  if (!_in->good()) {
+    _in.reset();
+    throw GameException("Unable to open recording " + path.string());
+  }
+  
+  char magic[RECORDING_MAGIC_LEN];
+  _in->read(magic, RECORDING_MAGIC_LEN);
+  if (!_in->good() or std::memcmp(magic, RECORDING_MAGIC, RECORDING_MAGIC_LEN) != 0) {
+    _in.reset();
+    throw GameException(path.string() + " is not a recording, or is from an incompatible version");
+  }
+  
+  unsigned int path_len = read_uint(*_in, 4);
+  _replay_ore_path.resize(path_len);
+  if (path_len > 0) {
+    _in->read(&_replay_ore_path[0], path_len);
+  }
+  unsigned int ore_size = read_uint(*_in, 4);
+  _replay_area = read_uint(*_in, 4);
+  _replay_mission = read_uint(*_in, 4);
+  if (!_in->good()) {
+    _in.reset();
+    throw GameException("Recording " + path.string() + " has a truncated header");
+  }
+  
+  if (boost::filesystem::exists(_replay_ore_path) and boost::filesystem::file_size(_replay_ore_path) != ore_size) {
+    Debug::error_msg("ORE package " + _replay_ore_path + " has changed since the recording was made, replay may not match");
+  }
+  
+  _max_speed = max_speed;
+  _cur_step_repeats = 0;
+  _steps = 0;
+  _start_ticks = SDL_GetTicks();
+  Input::start_replay();
+  Debug::status_msg((boost::format("Replaying %s: area %u, mission %u") % path.string() % _replay_area % _replay_mission).str());
+}
+
+void Recording::mission_started() {
+  if (_record_path.empty() or is_replaying()) {
+    return;
+  }
+  
+  _out.reset(new std::ofstream(_record_path.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc));
+  if (!_out->good()) {
+    Debug::error_msg("Unable to open " + _record_path.string() + " for recording");
+    _out.reset();
+    return;
+  }
+  
+  const std::string ore_path = Saving::get().config().lastOre();
+  _out->write(RECORDING_MAGIC, RECORDING_MAGIC_LEN);
+  write_uint(*_out, ore_path.size(), 4);
+  _out->write(ore_path.data(), ore_path.size());
+  write_uint(*_out, boost::filesystem::exists(ore_path) ? boost::filesystem::file_size(ore_path) : 0, 4);
+  write_uint(*_out, Globals::current_area->n(), 4);
+  write_uint(*_out, Globals::current_mission->n(), 4);
+  
+  _cur_step.clear();
+  _cur_step_repeats = 0;
+  _steps = 0;
+  Debug::status_msg("Recording input to " + _record_path.string());
+}
+
+void Recording::mission_ended() {
+  if (is_recording()) {
+    flush_step();
+    _out.reset();
+    Debug::status_msg("Recorded " + boost::lexical_cast<std::string>(_steps) + " steps to " + _record_path.string());
+  }
+}
+
+std::string Recording::capture_step() {
+  std::string data;
+  data.reserve(STEP_SNAPSHOT_LEN);
+  for (unsigned int i = 0; i < RECORDED_AXES_COUNT; ++i) {
+    const Channel& chn = Input::get_axis_ch(RECORDED_AXES[i]);
+    write_float(data, chn.get_value());
+    data.push_back((char)channel_flags(chn));
+  }
+  for (unsigned int i = 0; i < RECORDED_BUTTONS_COUNT; ++i) {
+    data.push_back((char)channel_flags(Input::get_button_ch(RECORDED_BUTTONS[i])));
+  }
+  return data;
+}
+
+void Recording::apply_step(const std::string& data) {
+  ReplayChannelSource& src = *Input::_replay;
+  unsigned int pos = 0;
+  for (unsigned int i = 0; i < RECORDED_AXES_COUNT; ++i) {
+    float value = read_float(data, pos);
+    unsigned char flags = data[pos + 4];
+    src.axis_channel(RECORDED_AXES[i]).set_state(flags & CHANNEL_FLAG_ON, flags & CHANNEL_FLAG_PARTIALLY_ON, flags & CHANNEL_FLAG_FRAME_MATCH, value);
+    pos += 5;
+  }
+  for (unsigned int i = 0; i < RECORDED_BUTTONS_COUNT; ++i) {
+    unsigned char flags = data[pos];
+    src.button_channel(RECORDED_BUTTONS[i]).set_state(flags & CHANNEL_FLAG_ON, flags & CHANNEL_FLAG_PARTIALLY_ON, flags & CHANNEL_FLAG_FRAME_MATCH, (flags & CHANNEL_FLAG_ON) ? 1.0 : 0.0);
+    pos += 1;
+  }
+}
+
+void Recording::flush_step() {
+  if (_cur_step_repeats > 0) {
+    write_uint(*_out, _cur_step_repeats, 2);
+    _out->write(_cur_step.data(), _cur_step.size());
+    _cur_step_repeats = 0;
+  }
+}
+
+void Recording::finish_replay() {
+  unsigned int ticks = SDL_GetTicks() - _start_ticks;
+  Debug::status_msg((boost::format("Replay finished: %u steps in %u ms (%.0f steps per second)")
+    % _steps % ticks % (ticks > 0 ? _steps*1000.0/ticks : 0.0)
+  ).str());
+  
+  _in.reset();
+  Input::stop_replay();
+  
+  if (_max_speed) {
+    throw GameQuitException("Replay finished");
+  }
+}
+
+void Recording::step() {
+  if (is_recording()) {
+    std::string data = capture_step();
+    if (_cur_step_repeats > 0 and (data != _cur_step or _cur_step_repeats == MAX_STEP_REPEATS)) {
+      flush_step();
+    }
+    _cur_step = data;
+    ++_cur_step_repeats;
+    ++_steps;
+  } else if (is_replaying()) {
+    if (_cur_step_repeats == 0) {
+      _cur_step_repeats = read_uint(*_in, 2);
+      _cur_step.resize(STEP_SNAPSHOT_LEN);
+      _in->read(&_cur_step[0], STEP_SNAPSHOT_LEN);
+      if (!_in->good() or _cur_step_repeats == 0) {
+        finish_replay();
+        return;
+      }
+      apply_step(_cur_step);
+    }
+    --_cur_step_repeats;
+    ++_steps;
+  }
+}
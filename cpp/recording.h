@@ -0,0 +1,90 @@
+/*
+recording.h: Header for the Recording class.
+This class records the state of the input channels on every simulation step, and replays those recordings.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#ifndef ORBIT_RIBBON_RECORDING_H
+#define ORBIT_RIBBON_RECORDING_H
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <fstream>
+#include <string>
+
+class App;
+class GameplayMode;
+class ModeStack;
+class ReplayChannelSource;
+
+// A recording starts with the identity of the ORE package and mission it was made in, followed by
+// run-length encoded per-step snapshots of every bound axis and button channel
+class Recording {
+  public:
+    static bool is_recording() { return _out.get() != 0; }
+    static bool is_replaying() { return _in.get() != 0; }
+    
+    // If true, replays are simulated as fast as possible and the game quits when the replay ends
+    static bool is_max_speed() { return _max_speed; }
+    
+    // Identity of the mission in the replay being run
+    static const std::string& get_replay_ore_path() { return _replay_ore_path; }
+    static unsigned int get_replay_area() { return _replay_area; }
+    static unsigned int get_replay_mission() { return _replay_mission; }
+  
+  private:
+    friend class App;
+    friend class GameplayMode;
+    friend class ModeStack;
+    
+    static boost::filesystem::path _record_path;
+    static boost::scoped_ptr<std::ofstream> _out;
+    static boost::scoped_ptr<std::ifstream> _in;
+    static bool _max_speed;
+    
+    static std::string _replay_ore_path;
+    static unsigned int _replay_area;
+    static unsigned int _replay_mission;
+    
+    // The snapshot most recently read or written, and how many more steps it covers
+    static std::string _cur_step;
+    static unsigned int _cur_step_repeats;
+    
+    static unsigned int _steps;
+    static unsigned int _start_ticks;
+    
+    // A recording will be made of the next mission to be started
+    static void set_record_path(const boost::filesystem::path& path) { _record_path = path; }
+    
+    // Opens a recording and reads its header; the caller has to load the mission it identifies
+    static void start_replay(const boost::filesystem::path& path, bool max_speed);
+    
+    static void mission_started();
+    static void mission_ended();
+    
+    // Called before each simulation step, to either save or load the input channel states for that step
+    static void step();
+    
+    static std::string capture_step();
+    static void apply_step(const std::string& data);
+    static void flush_step();
+    static void finish_replay();
+};
+
+#endif
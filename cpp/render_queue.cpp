@@ -0,0 +1,127 @@
+/*
+render_queue.cpp: Implementation for the RenderQueue class.
+This class collects the GameObjs to be drawn in a pass and draws them grouped by GL state.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <cmath>
+#include <limits>
+#include <map>
+
+#include "constants.h"
+#include "display.h"
+#include "gameobj.h"
+#include "render_queue.h"
+
+std::vector<RenderPacket> RenderQueue::_packets;
+bool RenderQueue::_sorted = false;
+bool RenderQueue::_flushed = false;
+unsigned int RenderQueue::_unsorted_state_changes = 0;
+Point RenderQueue::_eye;
+
+bool RenderPacket::operator<(const RenderPacket& other) const {
+  if (state.translucent != other.state.translucent) {
+    return other.state.translucent;
+  }
+  if (state.translucent and sq_dist != other.sq_dist) {
+    return sq_dist > other.sq_dist;
+  }
+  if (state.id != other.state.id) {
+    return state.id < other.state.id;
+  }
+  return state.mesh < other.state.mesh;
+}
+
+float RenderQueue::get_screen_radius(const Point& center, float radius) {
+  float dist = center.dist_to(_eye);
+  if (dist <= radius) {
+    return std::numeric_limits<float>::max();
+  }
+  return radius/dist * Display::get_screen_height()/(2*std::tan(deg2rad(FOV/2)));
+}
+
+unsigned int RenderQueue::get_state_id(const std::string& name) {
+  // Created on first use, for the same reason as in get_factory
+  static std::map<std::string, unsigned int> ids;
+  
+  std::map<std::string, unsigned int>::iterator i = ids.find(name);
+  if (i == ids.end()) {
+    i = ids.insert(std::make_pair(name, ids.size() + 1)).first;
+  }
+  return i->second;
+}
+
+void RenderQueue::submit(GameObj* obj, bool near) {
+  if (_flushed) {
+    _packets.clear();
+    _flushed = false;
+  }
+  
+  RenderPacket p;
+  p.state = obj->get_render_state();
+  p.obj = obj;
+  p.near = near;
+  p.sq_dist = p.state.translucent ? obj->get_pos().sq_dist_to(_eye) : 0;
+  _packets.push_back(p);
+  _sorted = false;
+}
+
+void RenderQueue::sort() {
+  if (_sorted) {
+    return;
+  }
+  
+  _unsorted_state_changes = count_state_changes();
+  // Stable, so that objects which compare equal keep being drawn in the same order from frame to frame
+  std::stable_sort(_packets.begin(), _packets.end());
+  _sorted = true;
+}
+
+RenderQueue::Stats RenderQueue::flush() {
+  Stats stats;
+  if (_flushed) {
+    return stats;
+  }
+  
+  sort();
+  BOOST_FOREACH(const RenderPacket& p, _packets) {
+    p.obj->draw(p.near);
+  }
+  
+  stats.draw_calls = _packets.size();
+  stats.state_changes = count_state_changes();
+  stats.unsorted_state_changes = _unsorted_state_changes;
+  _flushed = true;
+  return stats;
+}
+
+unsigned int RenderQueue::count_state_changes() {
+  // Packets with state 0 do their own setup, so each of them counts as a change
+  unsigned int changes = 0;
+  const RenderPacket* prev = 0;
+  BOOST_FOREACH(const RenderPacket& p, _packets) {
+    if (!prev or p.state.id == 0 or p.state.id != prev->state.id or p.state.translucent != prev->state.translucent) {
+      ++changes;
+    }
+    prev = &p;
+  }
+  return changes;
+}
@@ -0,0 +1,93 @@
+/*
+render_queue.h: Header for the RenderQueue class.
+This class collects the GameObjs to be drawn in a pass and draws them grouped by GL state.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#ifndef ORBIT_RIBBON_RENDER_QUEUE_H
+#define ORBIT_RIBBON_RENDER_QUEUE_H
+
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+
+class GameObj;
+
+// Describes what GL state an object's drawing needs, so that objects needing the same state can be drawn together
+struct RenderState {
+  unsigned int id; // From RenderQueue::get_state_id, or 0 for objects which set up whatever they need themselves
+  const void* mesh; // Objects drawing the same mesh are drawn one after the other within a state
+  bool translucent; // Drawn after everything opaque in the same pass, furthest first
+  
+  RenderState(unsigned int i = 0, const void* m = 0, bool t = false) : id(i), mesh(m), translucent(t) {}
+};
+
+struct RenderPacket {
+  RenderState state;
+  GameObj* obj;
+  bool near; // Whether the object's near or far drawing implementation is used
+  float sq_dist; // From the eye point, only set for translucent packets
+  
+  bool operator<(const RenderPacket& other) const;
+};
+
+// Objects are submitted in whatever order is convenient, then sorted and drawn by flush.
+// The sorted packets are kept until the next submit, so the order can be inspected without drawing anything.
+class RenderQueue {
+  public:
+    struct Stats {
+      unsigned int draw_calls;
+      unsigned int state_changes; // In the order the packets were drawn
+      unsigned int unsorted_state_changes; // In the order the packets were submitted, for comparison
+      Stats() : draw_calls(0), state_changes(0), unsorted_state_changes(0) {}
+    };
+    
+    // Returns the id for the named state, assigning a new one the first time a name is seen
+    static unsigned int get_state_id(const std::string& name);
+    
+    // Translucent packets are ordered by their distance from this point; ModeStack sets it from each frame's camera
+    static void set_eye(const Point& eye) { _eye = eye; }
+    static const Point& get_eye() { return _eye; }
+    
+    // How many pixels tall the radius of a sphere at center appears from the eye point, or a huge number if the eye is inside it
+    static float get_screen_radius(const Point& center, float radius);
+    
+    static void submit(GameObj* obj, bool near);
+    
+    // Puts the submitted packets in drawing order; flush calls this itself if it hasn't been done
+    static void sort();
+    
+    // Draws and clears the submitted packets, returning counts for just this flush
+    static Stats flush();
+    
+    // The packets from the most recent submit, sort, or flush
+    static const std::vector<RenderPacket>& get_packets() { return _packets; }
+  
+  private:
+    static std::vector<RenderPacket> _packets;
+    static bool _sorted;
+    static bool _flushed;
+    static unsigned int _unsorted_state_changes;
+    static Point _eye;
+    
+    static unsigned int count_state_changes();
+};
+
+#endif
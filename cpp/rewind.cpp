@@ -0,0 +1,329 @@
+/*
+rewind.cpp: Implementation for the Rewind class.
+This class keeps a bounded history of recent body states, and can play it back in reverse.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <ode/ode.h>
+#include <boost/format.hpp>
+#include <cmath>
+#include <cstring>
+
+#include "autoxsd/save.h"
+#include "constants.h"
+#include "debug.h"
+#include "gameobj.h"
+#include "globals.h"
+#include "input.h"
+#include "rewind.h"
+#include "sim.h"
+#include "trigger.h"
+
+// Total size of the ring buffer; the oldest frames are dropped to make room for new ones
+const unsigned int REWIND_BUFFER_BYTES = 1 << 20;
+
+// Upper limit on how far back history is kept, even when the buffer has room for more
+const unsigned int REWIND_MAX_FRAMES = 20*MAX_FPS;
+
+// How many steps apart keyframes are; rewinding has to decode forward from the nearest keyframe
+const unsigned int REWIND_KEYFRAME_INTERVAL = MAX_FPS/2;
+
+// Quantization steps for each stored value: 1mm positions, 1/64 m/s linear and 1/512 rad/s angular velocities
+const float REWIND_POS_QUANTA = 1024;
+const float REWIND_QUAT_QUANTA = 32767;
+const float REWIND_LINVEL_QUANTA = 64;
+const float REWIND_ANGVEL_QUANTA = 512;
+
+// How each body is stored within a frame
+const unsigned char REWIND_BODY_UNCHANGED = 0;
+const unsigned char REWIND_BODY_DELTA = 1;
+const unsigned char REWIND_BODY_FULL = 2;
+
+std::vector<unsigned char> Rewind::_ring;
+unsigned long long Rewind::_written = 0;
+std::deque<Rewind::Frame> Rewind::_frames;
+unsigned int Rewind::_steps_since_keyframe = 0;
+std::vector<GameObj*> Rewind::_objs;
+std::vector<Rewind::BodyState> Rewind::_last_states;
+Vector Rewind::_last_origin;
+Vector Rewind::_decoded_origin;
+std::vector<unsigned char> Rewind::_scratch;
+std::vector<Rewind::BodyState> Rewind::_decoded;
+
+boost::int16_t quantize16(dReal v, float quanta) {
+  long q = std::floor(v*quanta + 0.5);
+  if (q > 32767) { q = 32767; } else if (q < -32767) { q = -32767; }
+  return boost::int16_t(q);
+}
+
+template <typename T> void put(std::vector<unsigned char>& buf, const T& v) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+  buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template <typename T> void get(const unsigned char*& p, T& v) {
+  std::memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+}
+
+unsigned int Rewind::get_bytes_used() {
+  return _frames.empty() ? 0 : (unsigned int)(_written - _frames.front().start);
+}
+
+float Rewind::get_seconds_stored() {
+  return _frames.size()/float(MAX_FPS);
+}
+
+void Rewind::reset() {
+  if (_ring.empty()) {
+    _ring.resize(REWIND_BUFFER_BYTES);
+  }
+  _written = 0;
+  _frames.clear();
+  _steps_since_keyframe = 0;
+  _last_origin = Sim::get_origin_offset();
+  _decoded_origin = _last_origin;
+  
+  _objs.clear();
+  for (GOMap::iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
+    if (i->second->get_entity().has_id()) {
+      _objs.push_back(&*(i->second));
+    }
+  }
+  _last_states.resize(_objs.size());
+  _decoded.resize(_objs.size());
+}
+
+void Rewind::capture() {
+  if (_objs.empty()) {
+    return;
+  }
+  
+  // Delta positions are only meaningful relative to the same origin
+  bool keyframe = _frames.empty() or _steps_since_keyframe + 1 >= REWIND_KEYFRAME_INTERVAL or Sim::get_origin_offset() != _last_origin;
+  encode_frame(keyframe);
+  store_frame(keyframe);
+  _steps_since_keyframe = keyframe ? 0 : _steps_since_keyframe + 1;
+}
+
+void Rewind::encode_frame(bool keyframe) {
+  _scratch.clear();
+  put(_scratch, keyframe);
+  if (keyframe) {
+    _last_origin = Sim::get_origin_offset();
+    put(_scratch, _last_origin.x);
+    put(_scratch, _last_origin.y);
+    put(_scratch, _last_origin.z);
+  }
+  
+  for (unsigned int i = 0; i < _objs.size(); ++i) {
+    dBodyID b = _objs[i]->get_entity().get_id();
+    BodyState cur;
+    
+    const dReal* p = dBodyGetPosition(b);
+    for (unsigned int j = 0; j < 3; ++j) {
+      cur.pos[j] = boost::int32_t(std::floor(p[j]*REWIND_POS_QUANTA + 0.5));
+    }
+    p = dBodyGetQuaternion(b);
+    for (unsigned int j = 0; j < 4; ++j) {
+      cur.quat[j] = quantize16(p[j], REWIND_QUAT_QUANTA);
+    }
+    p = dBodyGetLinearVel(b);
+    for (unsigned int j = 0; j < 3; ++j) {
+      cur.linvel[j] = quantize16(p[j], REWIND_LINVEL_QUANTA);
+    }
+    p = dBodyGetAngularVel(b);
+    for (unsigned int j = 0; j < 3; ++j) {
+      cur.angvel[j] = quantize16(p[j], REWIND_ANGVEL_QUANTA);
+    }
+    
+    BodyState& last = _last_states[i];
+    if (!keyframe and std::memcmp(&cur, &last, sizeof(BodyState)) == 0) {
+      // Resting bodies cost a single byte per frame
+      put(_scratch, REWIND_BODY_UNCHANGED);
+    } else {
+      bool fits = !keyframe;
+      for (unsigned int j = 0; j < 3 and fits; ++j) {
+        long d = long(cur.pos[j]) - long(last.pos[j]);
+        fits = d >= -32767 and d <= 32767;
+      }
+      
+      if (fits) {
+        put(_scratch, REWIND_BODY_DELTA);
+        for (unsigned int j = 0; j < 3; ++j) {
+          put(_scratch, boost::int16_t(cur.pos[j] - last.pos[j]));
+        }
+      } else {
+        put(_scratch, REWIND_BODY_FULL);
+        put(_scratch, cur.pos);
+      }
+      put(_scratch, cur.quat);
+      put(_scratch, cur.linvel);
+      put(_scratch, cur.angvel);
+    }
+    
+    last = cur;
+  }
+}
+
+void Rewind::store_frame(bool keyframe) {
+  unsigned int len = _scratch.size();
+  if (len > _ring.size()) {
+    Debug::error_msg("Rewind frame is larger than the entire rewind buffer, discarding history");
+    _frames.clear();
+    return;
+  }
+  
+  // Make room by discarding the oldest frames, then any delta frames left without a keyframe to decode from
+  while (!_frames.empty() and (_frames.front().start + _ring.size() < _written + len or _frames.size() >= REWIND_MAX_FRAMES)) {
+    _frames.pop_front();
+  }
+  while (!_frames.empty() and !_frames.front().keyframe) {
+    _frames.pop_front();
+  }
+  
+  // A delta frame with nothing left before it can't be decoded; the next capture will be a keyframe since _frames is empty
+  if (_frames.empty() and !keyframe) {
+    return;
+  }
+  
+  Frame f;
+  f.start = _written;
+  f.len = len;
+  f.keyframe = keyframe;
+  
+  unsigned int pos = _written % _ring.size();
+  unsigned int first_part = std::min(len, (unsigned int)_ring.size() - pos);
+  std::memcpy(&_ring[pos], &_scratch[0], first_part);
+  if (first_part < len) {
+    std::memcpy(&_ring[0], &_scratch[first_part], len - first_part);
+  }
+  
+  _written += len;
+  _frames.push_back(f);
+}
+
+void Rewind::decode_through(std::deque<Frame>::size_type idx) {
+  std::deque<Frame>::size_type first = idx;
+  while (!_frames[first].keyframe) {
+    --first;
+  }
+  
+  for (std::deque<Frame>::size_type n = first; n <= idx; ++n) {
+    const Frame& f = _frames[n];
+    _scratch.resize(f.len);
+    unsigned int pos = f.start % _ring.size();
+    unsigned int first_part = std::min(f.len, (unsigned int)_ring.size() - pos);
+    std::memcpy(&_scratch[0], &_ring[pos], first_part);
+    if (first_part < f.len) {
+      std::memcpy(&_scratch[first_part], &_ring[0], f.len - first_part);
+    }
+    
+    const unsigned char* p = &_scratch[0];
+    bool keyframe;
+    get(p, keyframe);
+    if (keyframe) {
+      get(p, _decoded_origin.x);
+      get(p, _decoded_origin.y);
+      get(p, _decoded_origin.z);
+    }
+    for (unsigned int i = 0; i < _decoded.size(); ++i) {
+      BodyState& s = _decoded[i];
+      unsigned char how;
+      get(p, how);
+      if (how == REWIND_BODY_UNCHANGED) {
+        continue;
+      } else if (how == REWIND_BODY_DELTA) {
+        for (unsigned int j = 0; j < 3; ++j) {
+          boost::int16_t d;
+          get(p, d);
+          s.pos[j] += d;
+        }
+      } else {
+        get(p, s.pos);
+      }
+      get(p, s.quat);
+      get(p, s.linvel);
+      get(p, s.angvel);
+    }
+  }
+}
+
+void Rewind::apply(const std::vector<BodyState>& states) {
+  // Static geoms and triggers have to go back to where they were relative to the stored origin
+  Sim::rebase_origin(_decoded_origin - Sim::get_origin_offset());
+  
+  for (unsigned int i = 0; i < _objs.size(); ++i) {
+    dBodyID b = _objs[i]->get_entity().get_id();
+    const BodyState& s = states[i];
+    
+    dBodySetPosition(b, s.pos[0]/REWIND_POS_QUANTA, s.pos[1]/REWIND_POS_QUANTA, s.pos[2]/REWIND_POS_QUANTA);
+    
+    // Quantization leaves the quaternion slightly off unit length
+    dQuaternion q;
+    dReal len = 0;
+    for (unsigned int j = 0; j < 4; ++j) {
+      q[j] = s.quat[j]/REWIND_QUAT_QUANTA;
+      len += q[j]*q[j];
+    }
+    len = std::sqrt(len);
+    for (unsigned int j = 0; j < 4; ++j) {
+      q[j] /= len;
+    }
+    dBodySetQuaternion(b, q);
+    
+    dBodySetLinearVel(b, s.linvel[0]/REWIND_LINVEL_QUANTA, s.linvel[1]/REWIND_LINVEL_QUANTA, s.linvel[2]/REWIND_LINVEL_QUANTA);
+    dBodySetAngularVel(b, s.angvel[0]/REWIND_ANGVEL_QUANTA, s.angvel[1]/REWIND_ANGVEL_QUANTA, s.angvel[2]/REWIND_ANGVEL_QUANTA);
+    dBodySetForce(b, 0, 0, 0);
+    dBodySetTorque(b, 0, 0, 0);
+    dBodyEnable(b);
+    
+    _objs[i]->sync_from_body();
+  }
+  
+  Sim::forget_contacts();
+  Triggers::resync();
+}
+
+bool Rewind::step() {
+  if (!Input::get_button_ch(ORSave::ButtonBoundAction::Rewind).is_on()) {
+    return false;
+  }
+  
+  // The newest frame is the current state, so there must be at least one older frame to go back to
+  if (_frames.size() < 2) {
+    return false;
+  }
+  
+  // Frees the newest frame's space in the ring, so the next capture will overwrite it
+  _written = _frames.back().start;
+  _frames.pop_back();
+  
+  decode_through(_frames.size() - 1);
+  apply(_decoded);
+  _last_states = _decoded;
+  _last_origin = _decoded_origin;
+  
+  _steps_since_keyframe = 0;
+  for (std::deque<Frame>::reverse_iterator i = _frames.rbegin(); !i->keyframe; ++i) {
+    ++_steps_since_keyframe;
+  }
+  
+  return true;
+}
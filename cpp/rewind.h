@@ -0,0 +1,96 @@
+/*
+rewind.h: Header for the Rewind class.
+This class keeps a bounded history of recent body states, and can play it back in reverse.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#ifndef ORBIT_RIBBON_REWIND_H
+#define ORBIT_RIBBON_REWIND_H
+
+#include <boost/cstdint.hpp>
+#include <deque>
+#include <vector>
+
+#include "geometry.h"
+
+class GameObj;
+class GameplayMode;
+class ModeStack;
+
+// Every step's dynamic body states are quantized and stored in a fixed size byte ring
+// Each frame is either a keyframe, with every body stored in full, or a delta frame, where each body
+// is either unchanged or stored as a small position offset from the previous frame.
+// Only the bodies are rewound; mission time and other game state keep going forward.
+// Keyframes also record the simulation origin, and a new keyframe is forced whenever the origin moves.
+class Rewind {
+  public:
+    // Bytes of ring buffer in use and total, and how many seconds of history are available
+    static unsigned int get_bytes_used();
+    static unsigned int get_bytes_reserved() { return _ring.size(); }
+    static float get_seconds_stored();
+  
+  private:
+    friend class GameplayMode;
+    friend class ModeStack;
+    
+    // A body's state after quantization, as stored in keyframes
+    struct BodyState {
+      boost::int32_t pos[3];
+      boost::int16_t quat[4];
+      boost::int16_t linvel[3];
+      boost::int16_t angvel[3];
+    };
+    
+    struct Frame {
+      unsigned long long start; // Position in the ring, counted in total bytes ever written so it never wraps
+      unsigned int len;
+      bool keyframe;
+    };
+    
+    static std::vector<unsigned char> _ring;
+    static unsigned long long _written;
+    static std::deque<Frame> _frames;
+    static unsigned int _steps_since_keyframe;
+    
+    // The bodies being tracked, and their states as of the most recently captured frame
+    static std::vector<GameObj*> _objs;
+    static std::vector<BodyState> _last_states;
+    static Vector _last_origin;
+    static Vector _decoded_origin;
+    
+    // Reused between calls to avoid allocating every step
+    static std::vector<unsigned char> _scratch;
+    static std::vector<BodyState> _decoded;
+    
+    // Discards all history and starts tracking the bodies of the current set of GameObjs
+    static void reset();
+    
+    // Called after each simulation step to record the new body states
+    static void capture();
+    
+    // Called in place of a simulation step; returns false if there is no rewind input or no history left
+    static bool step();
+    
+    static void encode_frame(bool keyframe);
+    static void store_frame(bool keyframe);
+    static void decode_through(std::deque<Frame>::size_type idx);
+    static void apply(const std::vector<BodyState>& states);
+};
+
+#endif
@@ -22,17 +22,22 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
 //#include <GL/glew.h>
 #include <ode/ode.h>
+#include <algorithm>
 #include <cctype>
+#include <cmath>
 #include <vector>
 
 #include "autoxsd/orepkgdesc.h"
 #include "constants.h"
 #include "debug.h"
+#include "except.h"
 #include "gameobj.h"
 #include "globals.h"
 #include "sim.h"
+#include "trigger.h"
 
 dWorldID ode_world;
 dSpaceID static_space;
@@ -41,36 +46,139 @@ dJointGroupID contact_group;
 
 const unsigned int MAXIMUM_CONTACT_POINTS = 16;
 
-bool SimpleContactHandler::handle_collision(float t __attribute__ ((unused)), dGeomID other __attribute__ ((unused)), const dContactGeom* contacts __attribute__ ((unused)), unsigned int contacts_len __attribute__ ((unused))) {
+// Contact manifolds with more points than this are reduced down to this many before joints are created
+const unsigned int MAXIMUM_CONTACTS_PER_PAIR = 4;
+
+// A new contact closer than this to one of the previous step's contacts between the same geoms is treated as the same point
+const float CONTACT_PERSISTENCE_DIST = 0.05;
+
+// Bonus multiplier to a persisting contact's score during manifold reduction, so the chosen set stays stable between steps
+const float CONTACT_PERSISTENCE_BONUS = 1.25;
+
+// How far the focus can get from the origin along any axis before the origin is moved
+const float ORIGIN_REBASE_DIST = 2048;
+
+// The origin is only ever moved to multiples of this, which floats can represent exactly even far from the area origin
+const float ORIGIN_GRID_SIZE = 1024;
+
+Vector Sim::_origin_offset;
+Point Sim::_lod_focus;
+bool Sim::_has_lod_focus = false;
+
+// Surface parameters used for geoms whose objects don't specify any
+const float DEFAULT_SURFACE_MU = 5000;
+const float DEFAULT_SURFACE_BOUNCE = 0.5;
+
+// The contacts kept for a pair of geoms on the last step that they touched
+struct CachedManifold {
+  unsigned int last_step;
+  unsigned int len;
+  boost::array<Point, MAXIMUM_CONTACTS_PER_PAIR> points;
+};
+
+typedef std::pair<dGeomID, dGeomID> GeomPair;
+typedef boost::unordered_map<GeomPair, CachedManifold> ContactCache;
+ContactCache contact_cache;
+
+SurfaceMaterial::SurfaceMaterial() :
+  mu(DEFAULT_SURFACE_MU),
+  bounce(DEFAULT_SURFACE_BOUNCE)
+{}
+
+SurfaceMaterial SurfaceMaterial::combine(const SurfaceMaterial& a, const SurfaceMaterial& b) {
+  return SurfaceMaterial(std::sqrt(a.mu*b.mu), std::max(a.bounce, b.bounce));
+}
+
+void ContactView::copy_to(dContactGeom* dest) const {
+  for (unsigned int i = 0; i < _len; ++i) {
+    dest[i] = _c[i];
+    if (_flipped) {
+      dest[i].normal[0] = -_c[i].normal[0];
+      dest[i].normal[1] = -_c[i].normal[1];
+      dest[i].normal[2] = -_c[i].normal[2];
+      dest[i].g1 = _c[i].g2; dest[i].g2 = _c[i].g1;
+      dest[i].side1 = _c[i].side2; dest[i].side2 = _c[i].side1;
+    }
+  }
+}
+
+bool SimpleContactHandler::handle_collision(float t __attribute__ ((unused)), dGeomID other __attribute__ ((unused)), const ContactView& c __attribute__ ((unused))) {
   return true;
 }
 
-void CollisionTracker::Collision::init(float t, dGeomID o, const dContactGeom* c, unsigned int c_len) {
+// Number of contacts that fit in each page of the ContactArena; must be at least MAXIMUM_CONTACT_POINTS
+const unsigned int CONTACT_ARENA_PAGE_SIZE = 256;
+
+ContactArena contact_arena;
+
+ContactArena::~ContactArena() {
+  BOOST_FOREACH(dContactGeom* page, _pages) {
+    delete[] page;
+  }
+}
+
+ContactSpan ContactArena::store(const ContactView& c) {
+  unsigned int c_len = c.size();
+  if (c_len > CONTACT_ARENA_PAGE_SIZE) {
+    throw GameException("Attempted to store " + boost::lexical_cast<std::string>(c_len) + " contacts in one ContactArena page");
+  }
+  
+  if (_pages.size() == 0 or _cur_used + c_len > CONTACT_ARENA_PAGE_SIZE) {
+    if (_pages.size() > 0) {
+      ++_cur_page;
+      _cur_used = 0;
+    }
+    if (_cur_page == _pages.size()) {
+      _pages.push_back(new dContactGeom[CONTACT_ARENA_PAGE_SIZE]);
+      Debug::debug_msg("Contact arena grew to " + boost::lexical_cast<std::string>(_pages.size()) + " pages");
+    }
+  }
+  
+  dContactGeom* dest = _pages[_cur_page] + _cur_used;
+  c.copy_to(dest);
+  _cur_used += c_len;
+  return ContactSpan(dest, c_len);
+}
+
+void ContactArena::reset() {
+  _cur_page = 0;
+  _cur_used = 0;
+  ++_generation;
+}
+
+void CollisionTracker::Collision::init(float t, dGeomID o, const ContactView& c) {
   step_time = t;
   other = o;
-  other_gameobj = static_cast<GameObj*>(dGeomGetData(o));
-  
-  contacts.reserve(c_len);
-  for (unsigned int i = 0; i < c_len; ++i) {
-    contacts.push_back(*c);
-    ++c;
+  dBodyID other_body = dGeomGetBody(o);
+  other_gameobj = other_body == 0 ? 0 : OdeEntity::get_gameobj_from_body(other_body);
+  contacts = contact_arena.store(c);
+}
+
+CollisionTracker::CollisionTracker() :
+  _generation(contact_arena.get_generation())
+{}
+
+void CollisionTracker::discard_stale_collisions() {
+  if (_generation != contact_arena.get_generation()) {
+    _collisions.clear();
+    _generation = contact_arena.get_generation();
   }
 }
 
-CollisionTracker::CollisionTracker() {
-  _collisions.reset(new std::vector<CollisionTracker::Collision>);
+bool CollisionTracker::handle_collision(float t, dGeomID o, const ContactView& c) {
+  discard_stale_collisions();
+  _collisions.push_back(Collision());
+  _collisions.back().init(t, o, c);
+  return should_contact(t, o, c);
 }
 
-bool CollisionTracker::handle_collision(float t, dGeomID o, const dContactGeom* c, unsigned int c_len) {
-  _collisions->push_back(Collision());
-  _collisions->back().init(t, o, c, c_len);
-  return should_contact(t, o, c, c_len);
+bool CollisionTracker::has_collisions() const {
+  return _generation == contact_arena.get_generation() and _collisions.size() > 0;
 }
 
-std::auto_ptr<std::vector<CollisionTracker::Collision> > CollisionTracker::get_collisions() {
-  std::auto_ptr<std::vector<CollisionTracker::Collision> > ret(_collisions);
-  _collisions.reset(new std::vector<CollisionTracker::Collision>);
-  return ret;
+const std::vector<CollisionTracker::Collision>& CollisionTracker::get_collisions() {
+  discard_stale_collisions();
+  return _collisions;
 }
 
 dWorldID Sim::get_ode_world() {
@@ -85,6 +193,10 @@ dSpaceID Sim::get_dyn_space() {
   return dyn_space;
 }
 
+ContactArena& Sim::get_contact_arena() {
+  return contact_arena;
+}
+
 void Sim::init() {
   dInitODE();
   ode_world = dWorldCreate();
@@ -95,6 +207,7 @@ void Sim::init() {
 }
 
 void Sim::deinit() {
+  contact_cache.clear();
   dJointGroupDestroy(contact_group);
   dSpaceDestroy(dyn_space);
   dSpaceDestroy(static_space);
@@ -102,6 +215,108 @@ void Sim::deinit() {
   dCloseODE();
 }
 
+// Functions for consulting the handlers of a colliding pair, chosen by the kinds of the two handlers
+// Each returns true if contact joints should be created between the two geoms.
+typedef bool (*CollisionDispatchFunc)(float t, dGeomID o1, CollisionHandler* h1, dGeomID o2, CollisionHandler* h2, const ContactView& c);
+
+bool dispatch_neither(float, dGeomID, CollisionHandler*, dGeomID, CollisionHandler*, const ContactView&) {
+  return true;
+}
+
+bool dispatch_first(float t, dGeomID o1 __attribute__ ((unused)), CollisionHandler* h1, dGeomID o2, CollisionHandler* h2 __attribute__ ((unused)), const ContactView& c) {
+  return h1->handle_collision(t, o2, c);
+}
+
+bool dispatch_second(float t, dGeomID o1, CollisionHandler* h1 __attribute__ ((unused)), dGeomID o2 __attribute__ ((unused)), CollisionHandler* h2, const ContactView& c) {
+  return h2->handle_collision(t, o1, c.flipped());
+}
+
+bool dispatch_both(float t, dGeomID o1, CollisionHandler* h1, dGeomID o2, CollisionHandler* h2, const ContactView& c) {
+  // Both handlers have to be called even if the first one refuses the contact, since they may have side effects
+  bool contact1 = h1->handle_collision(t, o2, c);
+  bool contact2 = h2->handle_collision(t, o1, c.flipped());
+  return contact1 && contact2;
+}
+
+bool dispatch_first_sensor(float t, dGeomID o1, CollisionHandler* h1, dGeomID o2, CollisionHandler* h2, const ContactView& c) {
+  dispatch_first(t, o1, h1, o2, h2, c);
+  return false;
+}
+
+bool dispatch_second_sensor(float t, dGeomID o1, CollisionHandler* h1, dGeomID o2, CollisionHandler* h2, const ContactView& c) {
+  dispatch_second(t, o1, h1, o2, h2, c);
+  return false;
+}
+
+bool dispatch_both_sensor(float t, dGeomID o1, CollisionHandler* h1, dGeomID o2, CollisionHandler* h2, const ContactView& c) {
+  dispatch_both(t, o1, h1, o2, h2, c);
+  return false;
+}
+
+// Indexed by the kind of the first geom's handler, then the kind of the second geom's handler
+const CollisionDispatchFunc COLLISION_DISPATCH_TABLE[CollisionHandler::KIND_COUNT][CollisionHandler::KIND_COUNT] = {
+  /* PASSIVE */ { &dispatch_neither, &dispatch_second, &dispatch_second_sensor },
+  /* ACTIVE */ { &dispatch_first, &dispatch_both, &dispatch_both_sensor },
+  /* SENSOR */ { &dispatch_first_sensor, &dispatch_both_sensor, &dispatch_both_sensor }
+};
+
+bool is_persisting_contact(const Point& p, const CachedManifold* cached) {
+  if (cached != 0) {
+    for (unsigned int i = 0; i < cached->len; ++i) {
+      if (p.sq_dist_to(cached->points[i]) < CONTACT_PERSISTENCE_DIST*CONTACT_PERSISTENCE_DIST) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Reorders the contacts so that the most significant MAXIMUM_CONTACTS_PER_PAIR of them come first, and returns how many to keep
+// The deepest contact is picked first, then the one farthest from it, then the two that most enlarge the area the manifold covers.
+unsigned int reduce_contacts(dContactGeom* c, unsigned int len, const CachedManifold* cached) {
+  if (len <= MAXIMUM_CONTACTS_PER_PAIR) {
+    return len;
+  }
+  
+  Point pos[MAXIMUM_CONTACT_POINTS];
+  float bonus[MAXIMUM_CONTACT_POINTS];
+  for (unsigned int i = 0; i < len; ++i) {
+    pos[i] = Point(c[i].pos);
+    bonus[i] = is_persisting_contact(pos[i], cached) ? CONTACT_PERSISTENCE_BONUS : 1.0;
+  }
+  
+  for (unsigned int n = 0; n < MAXIMUM_CONTACTS_PER_PAIR; ++n) {
+    unsigned int best = n;
+    float best_score = -1;
+    for (unsigned int i = n; i < len; ++i) {
+      float score;
+      if (n == 0) {
+        score = c[i].depth;
+      } else if (n == 1) {
+        score = pos[i].sq_dist_to(pos[0]);
+      } else if (n == 2) {
+        score = (pos[1] - pos[0]).cross_prod(pos[i] - pos[0]).mag();
+      } else {
+        score =
+          (pos[0] - pos[i]).cross_prod(pos[1] - pos[i]).mag() +
+          (pos[1] - pos[i]).cross_prod(pos[2] - pos[i]).mag() +
+          (pos[2] - pos[i]).cross_prod(pos[0] - pos[i]).mag();
+      }
+      score *= bonus[i];
+      if (score > best_score) {
+        best = i;
+        best_score = score;
+      }
+    }
+    
+    std::swap(c[n], c[best]);
+    std::swap(pos[n], pos[best]);
+    std::swap(bonus[n], bonus[best]);
+  }
+  
+  return MAXIMUM_CONTACTS_PER_PAIR;
+}
+
 void collision_callback(void* data, dGeomID o1, dGeomID o2) {
   float step_time = *static_cast<float*>(data);
   
@@ -110,38 +325,38 @@ void collision_callback(void* data, dGeomID o1, dGeomID o2) {
     dSpaceCollide2(o1, o2, NULL, &collision_callback);
   } else {
     if (dGeomIsEnabled(o1) && dGeomIsEnabled(o2)) {
-      unsigned int len = dCollide(o1, o2, MAXIMUM_CONTACT_POINTS, &(contacts[0]), sizeof(dContactGeom));
+      CollisionHandler* o1h = static_cast<CollisionHandler*>(dGeomGetData(o1));
+      CollisionHandler* o2h = static_cast<CollisionHandler*>(dGeomGetData(o2));
+      
+      // No joints will come of a collision against a sensor, so there's no point in generating more than one contact
+      bool sensor = o1h->get_kind() == CollisionHandler::SENSOR or o2h->get_kind() == CollisionHandler::SENSOR;
+      unsigned int len = dCollide(o1, o2, sensor ? 1 : MAXIMUM_CONTACT_POINTS, &(contacts[0]), sizeof(dContactGeom));
       if (len > 0) {
         /*
         for (unsigned int i = 0; i < len; ++i) {
           Debug::debug_msg("C" + boost::lexical_cast<std::string>(i) + " " + boost::lexical_cast<std::string>(contacts[i].side1) + ":" + boost::lexical_cast<std::string>(contacts[i].side2));
         }
         */
-        CollisionHandler* o1h = static_cast<CollisionHandler*>(dGeomGetData(o1));
-        CollisionHandler* o2h = static_cast<CollisionHandler*>(dGeomGetData(o2));
-        bool contact1 = o1h->handle_collision(step_time, o2, &(contacts[0]), len);
-        for (unsigned int i = 0; i < len; ++i) {
-          // Reverse each contact so that o2h sees itself as the first geom
-          contacts[i].normal[0] = -contacts[i].normal[0];
-          contacts[i].normal[1] = -contacts[i].normal[1];
-          contacts[i].normal[2] = -contacts[i].normal[2];
-          dGeomID tempG = contacts[i].g1; contacts[i].g1 = contacts[i].g2; contacts[i].g2 = tempG;
-          int tempS = contacts[i].side1; contacts[i].side1 = contacts[i].side2; contacts[i].side2 = tempS;
-        }
-        bool contact2 = o2h->handle_collision(step_time, o1, &(contacts[0]), len);
+        // Order the key so that the same pair is found no matter which way round the space reports it
+        GeomPair key = o1 < o2 ? GeomPair(o1, o2) : GeomPair(o2, o1);
+        ContactCache::iterator cache_iter = contact_cache.find(key);
+        const CachedManifold* cached = cache_iter == contact_cache.end() ? 0 : &cache_iter->second;
+        len = reduce_contacts(&(contacts[0]), len, cached);
+        
+        CachedManifold& manifold = cached == 0 ? contact_cache[key] : cache_iter->second;
+        manifold.last_step = Globals::total_steps;
+        manifold.len = len;
         for (unsigned int i = 0; i < len; ++i) {
-          // Reverse each contact so that o2h sees itself as the first geom
-          contacts[i].normal[0] = -contacts[i].normal[0];
-          contacts[i].normal[1] = -contacts[i].normal[1];
-          contacts[i].normal[2] = -contacts[i].normal[2];
-          dGeomID tempG = contacts[i].g1; contacts[i].g1 = contacts[i].g2; contacts[i].g2 = tempG;
-          int tempS = contacts[i].side1; contacts[i].side1 = contacts[i].side2; contacts[i].side2 = tempS;
+          manifold.points[i] = Point(contacts[i].pos);
         }
-        if (contact1 && contact2) {
+        
+        CollisionDispatchFunc dispatch = COLLISION_DISPATCH_TABLE[o1h->get_kind()][o2h->get_kind()];
+        if (dispatch(step_time, o1, o1h, o2, o2h, ContactView(&(contacts[0]), len))) {
+          SurfaceMaterial material = SurfaceMaterial::combine(o1h->get_material(), o2h->get_material());
           dContact contact;
           contact.surface.mode = dContactApprox1 | dContactBounce;
-          contact.surface.bounce = 0.5;
-          contact.surface.mu = 5000;
+          contact.surface.bounce = material.bounce;
+          contact.surface.mu = material.mu;
           for (unsigned int ci = 0; ci < len; ++ci) {
             contact.geom = contacts[ci];
             dJointID joint = dJointCreateContact(ode_world, contact_group, &contact);
@@ -156,6 +371,17 @@ void collision_callback(void* data, dGeomID o1, dGeomID o2) {
 void Sim::sim_step() {
   // Check for collisions
   dJointGroupEmpty(contact_group);
+  contact_arena.reset();
+  
+  // Forget about contacts between pairs which stopped touching on the last step
+  for (ContactCache::iterator i = contact_cache.begin(); i != contact_cache.end();) {
+    if (i->second.last_step + 1 < Globals::total_steps) {
+      i = contact_cache.erase(i);
+    } else {
+      ++i;
+    }
+  }
+  
   float step_time = (float)Globals::total_steps;
   dSpaceCollide(dyn_space, &step_time, &collision_callback); // Collisions among dyn_space objects
   dSpaceCollide2(dGeomID(dyn_space), dGeomID(static_space), &step_time, &collision_callback); // Collisions between dyn_space objects and static_space objects
@@ -168,9 +394,47 @@ void Sim::sim_step() {
     i->second->step();
   }
   
+  // Now that every GameObj knows its new position, see which trigger volumes were set off
+  Triggers::step();
+  
   Globals::total_steps += 1;
 }
 
+void Sim::forget_contacts() {
+  contact_cache.clear();
+  contact_arena.reset();
+}
+
+void Sim::rebase_origin(const Vector& shift) {
+  if (shift.x == 0 and shift.y == 0 and shift.z == 0) {
+    return;
+  }
+  
+  for (GOMap::iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
+    i->second->rebase(shift);
+  }
+  Triggers::rebase(shift);
+  _lod_focus -= shift;
+  
+  // Cached contact positions are in the old frame; it's simpler to drop them than to shift them
+  forget_contacts();
+  
+  _origin_offset += shift;
+  Debug::debug_msg("Simulation origin moved to " + _origin_offset.to_str());
+}
+
+void Sim::recenter_on(const Point& focus) {
+  if (std::fabs(focus.x) < ORIGIN_REBASE_DIST and std::fabs(focus.y) < ORIGIN_REBASE_DIST and std::fabs(focus.z) < ORIGIN_REBASE_DIST) {
+    return;
+  }
+  
+  rebase_origin(Vector(
+    std::floor(focus.x/ORIGIN_GRID_SIZE + 0.5)*ORIGIN_GRID_SIZE,
+    std::floor(focus.y/ORIGIN_GRID_SIZE + 0.5)*ORIGIN_GRID_SIZE,
+    std::floor(focus.z/ORIGIN_GRID_SIZE + 0.5)*ORIGIN_GRID_SIZE
+  ));
+}
+
 std::auto_ptr<OdeEntity> Sim::gen_empty_body() {
   return std::auto_ptr<OdeEntity>(new OdeEntity);
 }
@@ -183,7 +447,7 @@ std::auto_ptr<OdeEntity> Sim::gen_sphere_body(float mass, float rad) {
   return std::auto_ptr<OdeEntity>(new OdeEntity(body));
 }
 
-dBodyID OdeEntity::get_id() {
+dBodyID OdeEntity::get_id() const {
   if (_id == 0) {
     throw GameException("Attempted to retrieve id from bodyless OdeEntity");
   } else {
@@ -191,7 +455,7 @@ dBodyID OdeEntity::get_id() {
   }
 }
 
-dGeomID OdeEntity::get_geom(const std::string& gname) {
+dGeomID OdeEntity::get_geom(const std::string& gname) const {
   std::map<std::string, dGeomID>::const_iterator i = _geoms.find(gname);
   if (i == _geoms.end()) {
     throw GameException("Unable to retrieve geom named " + gname);
@@ -206,6 +470,7 @@ CollisionHandler* OdeEntity::get_geom_ch(const std::string& gname) {
 
 void OdeEntity::set_geom(const std::string& gname, dGeomID geom, std::auto_ptr<CollisionHandler> ch, const ORE1::ObjType* offset) {
   // From here on out, we have to manage the memory for this CollisionHandler manually
+  ch->set_material(_material);
   dGeomSetData(geom, ch.release());
   
   // TODO possible optimization : to automatically use a space if a body has more than one geom
@@ -247,6 +512,13 @@ void OdeEntity::set_geom(const std::string& gname, dGeomID geom, std::auto_ptr<C
   }
 }
 
+void OdeEntity::set_material(const SurfaceMaterial& material) {
+  _material = material;
+  BOOST_FOREACH(GeomMap::value_type& p, _geoms) {
+    static_cast<CollisionHandler*>(dGeomGetData(p.second))->set_material(material);
+  }
+}
+
 void OdeEntity::set_pos(const Point& pos) {
   _last_pos = pos;
   
@@ -259,6 +531,20 @@ void OdeEntity::set_pos(const Point& pos) {
   }
 }
 
+void OdeEntity::translate(const Vector& v) {
+  _last_pos += v;
+  
+  if (_id != 0) {
+    const dReal* p = dBodyGetPosition(_id);
+    dBodySetPosition(_id, p[0] + v.x, p[1] + v.y, p[2] + v.z);
+  } else {
+    BOOST_FOREACH(GeomMap::value_type& p, _geoms) {
+      const dReal* g = dGeomGetPosition(p.second);
+      dGeomSetPosition(p.second, g[0] + v.x, g[1] + v.y, g[2] + v.z);
+    }
+  }
+}
+
 void OdeEntity::set_rot(const boost::array<float, 9>& rot) {
   _last_rot = rot;
   
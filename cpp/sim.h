@@ -38,17 +38,121 @@ class App;
 class GameObj;
 class CollisionTracker;
 
+// Surface parameters used for contact joints against a geom
+struct SurfaceMaterial {
+  float mu; // Coulomb friction coefficient
+  float bounce; // Restitution, from 0 (no bounce) to 1 (maximum bounce)
+  
+  SurfaceMaterial();
+  SurfaceMaterial(float m, float b) : mu(m), bounce(b) {}
+  
+  // Combines the materials of two touching geoms into the parameters for the contacts between them
+  static SurfaceMaterial combine(const SurfaceMaterial& a, const SurfaceMaterial& b);
+};
+
+// A read-only view of the contacts between two geoms, as seen from one of those geoms
+// A flipped view presents each contact with g1/g2 and side1/side2 swapped and the normal reversed, so that
+// the handler looking through it finds its own geom in g1, without the contacts themselves being rewritten.
+class ContactView {
+  public:
+    ContactView(const dContactGeom* c, unsigned int len, bool flipped = false) : _c(c), _len(len), _flipped(flipped) {}
+    
+    unsigned int size() const { return _len; }
+    bool empty() const { return _len == 0; }
+    ContactView flipped() const { return ContactView(_c, _len, !_flipped); }
+    
+    Point pos(unsigned int i) const { return Point(_c[i].pos); }
+    Vector normal(unsigned int i) const { return _flipped ? -Vector(_c[i].normal) : Vector(_c[i].normal); }
+    dReal depth(unsigned int i) const { return _c[i].depth; }
+    dGeomID g1(unsigned int i) const { return _flipped ? _c[i].g2 : _c[i].g1; }
+    dGeomID g2(unsigned int i) const { return _flipped ? _c[i].g1 : _c[i].g2; }
+    int side1(unsigned int i) const { return _flipped ? _c[i].side2 : _c[i].side1; }
+    int side2(unsigned int i) const { return _flipped ? _c[i].side1 : _c[i].side2; }
+    
+    // Writes out the contacts as they appear through this view
+    void copy_to(dContactGeom* dest) const;
+  
+  private:
+    const dContactGeom* _c;
+    unsigned int _len;
+    bool _flipped;
+};
+
 class CollisionHandler {
   public:
+    // Determines which handlers collision_callback needs to consult for a colliding pair
+    enum Kind {
+      PASSIVE, // Always agrees to contact joints and has no side effects, so it doesn't need to be called at all
+      ACTIVE, // Has to be called, and decides whether contact joints are created
+      SENSOR, // Has to be called, but contact joints are never created against it
+      KIND_COUNT
+    };
+    
+    CollisionHandler(Kind kind = ACTIVE) : _kind(kind) {}
+    
     // Returns true if a contact joint should be created (a joint is actually created only if both geoms' handlers agree that one should be)
-    virtual bool handle_collision(float t, dGeomID o, const dContactGeom* c, unsigned int c_len) =0;
+    // In the contacts, g1 is always the geom that this handler is attached to, and o is the other geom.
+    virtual bool handle_collision(float t, dGeomID o, const ContactView& c) =0;
+    
+    Kind get_kind() const { return _kind; }
+    
+    const SurfaceMaterial& get_material() const { return _material; }
+    void set_material(const SurfaceMaterial& material) { _material = material; }
+  
+  private:
+    Kind _kind;
+    SurfaceMaterial _material;
 };
 
 class SimpleContactHandler : public CollisionHandler {
   public:
-    SimpleContactHandler() {}
+    SimpleContactHandler(Kind kind = ACTIVE) : CollisionHandler(kind) {}
+    
+    bool handle_collision(float t, dGeomID other, const ContactView& c);
+};
+
+// A read-only view over a run of contacts, usually ones stored in a ContactArena
+class ContactSpan {
+  public:
+    ContactSpan() : _begin(0), _len(0) {}
+    ContactSpan(const dContactGeom* begin, unsigned int len) : _begin(begin), _len(len) {}
     
-    bool handle_collision(float t, dGeomID other, const dContactGeom* contacts, unsigned int contacts_len);
+    const dContactGeom& operator[](unsigned int i) const { return _begin[i]; }
+    const dContactGeom* begin() const { return _begin; }
+    const dContactGeom* end() const { return _begin + _len; }
+    unsigned int size() const { return _len; }
+    bool empty() const { return _len == 0; }
+  
+  private:
+    const dContactGeom* _begin;
+    unsigned int _len;
+};
+
+// Holds copies of the contacts recorded during a single simulation step
+// Storage is divided into fixed-size pages which are kept around and reused after each reset, so
+// once the arena has grown large enough for the busiest step it never touches the heap again.
+class ContactArena : boost::noncopyable {
+  public:
+    ContactArena() : _cur_page(0), _cur_used(0), _generation(0) {}
+    ~ContactArena();
+    
+    // Copies the given contacts into the arena; the returned span is valid until the next reset
+    ContactSpan store(const ContactView& c);
+    
+    // Invalidates all spans handed out so far, but keeps the pages for reuse
+    void reset();
+    
+    // Increases by one on each reset; used to detect records left over from a prior step
+    unsigned int get_generation() const { return _generation; }
+    
+    // Total number of pages ever allocated; this stops increasing once the arena has warmed up
+    unsigned int get_pages_allocated() const { return _pages.size(); }
+  
+  private:
+    std::vector<dContactGeom*> _pages;
+    unsigned int _cur_page;
+    unsigned int _cur_used;
+    unsigned int _generation;
 };
 
 class CollisionTracker : public CollisionHandler {
@@ -58,24 +162,31 @@ class CollisionTracker : public CollisionHandler {
         float step_time;
         dGeomID other;
         const GameObj* other_gameobj;
-        std::vector<dContactGeom> contacts;
+        ContactSpan contacts;
       
       private:
         friend class CollisionTracker;
       
         Collision() {}
-        void init(float t, dGeomID o, const dContactGeom* c, unsigned int c_len);
+        void init(float t, dGeomID o, const ContactView& c);
     };
     
     CollisionTracker();
-    bool handle_collision(float t, dGeomID o, const dContactGeom* c, unsigned int c_len);
-    bool has_collisions() const { return _collisions->size() > 0; }
-    std::auto_ptr<std::vector<Collision> > get_collisions();
+    bool handle_collision(float t, dGeomID o, const ContactView& c);
+    bool has_collisions() const;
+    
+    // Returns the collisions recorded during the most recent step
+    // The returned reference, and the contacts it points to, are only valid until the next step.
+    const std::vector<Collision>& get_collisions();
     
-    virtual bool should_contact(float t, dGeomID o, const dContactGeom* c, unsigned int c_len) const =0;
+    virtual bool should_contact(float t, dGeomID o, const ContactView& c) const =0;
   
   private:
-    std::auto_ptr<std::vector<Collision> > _collisions;
+    // Cleared rather than reallocated each step, so its capacity is reused
+    std::vector<Collision> _collisions;
+    unsigned int _generation;
+    
+    void discard_stale_collisions();
 };
 
 
@@ -89,11 +200,40 @@ class Sim {
     static std::auto_ptr<OdeEntity> gen_empty_body();
     static std::auto_ptr<OdeEntity> gen_sphere_body(float mass, float rad);
     
+    static ContactArena& get_contact_arena();
+    
     static void sim_step();
+    
+    // Drops cached manifolds and this step's recorded contacts, for when bodies have been teleported
+    static void forget_contacts();
+    
+    // Where the simulation's origin currently is in area coordinates
+    // Everything in the simulation is kept relative to this, so that coordinates near the avatar stay small.
+    static const Vector& get_origin_offset() { return _origin_offset; }
+    
+    // Moves the origin by shift, translating every body, geom, and trigger volume by -shift to compensate
+    static void rebase_origin(const Vector& shift);
+    
+    // Rebases onto a grid point near focus, if focus has gotten too far from the current origin
+    static void recenter_on(const Point& focus);
+    
+    // GameObjs far from the LOD focus are stepped less often, as set out by their type's SimLodPolicy
+    // With no focus set, everything is stepped at full rate.
+    static void set_lod_focus(const Point& focus) { _lod_focus = focus; _has_lod_focus = true; }
+    static void clear_lod_focus() { _has_lod_focus = false; }
+    static bool has_lod_focus() { return _has_lod_focus; }
+    static const Point& get_lod_focus() { return _lod_focus; }
   
   private:
+    static Vector _origin_offset;
+    static Point _lod_focus;
+    static bool _has_lod_focus;
+    
     static void init();
     static void deinit();
+    
+    // Puts the origin back at the area origin; only for use when no GameObjs exist
+    static void reset_origin() { _origin_offset = Vector(); }
 
     friend class App;
 };
@@ -110,21 +250,28 @@ class OdeEntity : boost::noncopyable {
     
     dBodyID _id;
     GeomMap _geoms;
+    SurfaceMaterial _material;
     
     OdeEntity() : _id(0) {}
     OdeEntity(dBodyID id) : _id(id) {}
     
   public:
     bool has_id() const { return _id != 0; }
-    dBodyID get_id();
+    dBodyID get_id() const;
     
-    dGeomID get_geom(const std::string& gname);
+    dGeomID get_geom(const std::string& gname) const;
     CollisionHandler* get_geom_ch(const std::string& gname);
     void set_geom(const std::string& gname, dGeomID geom, std::auto_ptr<CollisionHandler> ch, const ORE1::ObjType* offset = 0);
     
+    // Sets the surface material of all current geoms, and of geoms set after this call
+    void set_material(const SurfaceMaterial& material);
+    
     void set_pos(const Point& pos);
     void set_rot(const boost::array<float, 9>& rot);
     
+    // Moves the body, or each geom if there's no body, without disturbing geom offsets
+    void translate(const Vector& v);
+    
     static GameObj* get_gameobj_from_body(dBodyID b);
     void set_gameobj(GameObj* g);
     
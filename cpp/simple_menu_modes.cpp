@@ -121,8 +121,9 @@ void MainMenuMode::draw_2d(bool top __attribute__ ((unused))) {
     Display::get_screen_width()/2 - _title_tex->get_width()/2,
     Display::get_screen_height()*0.25 - _title_tex->get_height()/2
   );
+  GUI::Batch::flush(); // The title image is drawn directly, and goes over the menu's frame
   _title_tex->draw_2d(title_pos); 
-
+  
   float font_height = 13.0;
   float buf = 3;
   Globals::sys_font->draw(Point(buf, Display::get_screen_height() - font_height*1 - buf), font_height, std::string("Version: ") + APP_VERSION);
@@ -227,10 +228,16 @@ void MissionSelectMenuMode::handle_menu_selection(const std::string& item) {
 
 PauseMenuMode::PauseMenuMode() : SimpleMenuMode(false, 150, 30, 15) {
   add_entry("resume", "Resume Game");
+  add_entry("checkpoint", "Last Checkpoint");
+  add_entry("restart", "Restart Mission");
   add_entry("options", "Options");
   add_entry("quit", "Quit Mission");
 }
 
+void PauseMenuMode::prior_top(const boost::shared_ptr<Mode>& m) {
+  _gameplay_mode = boost::dynamic_pointer_cast<GameplayMode>(m);
+}
+
 bool PauseMenuMode::handle_input() {
   if (Input::get_button_ch(ORSave::ButtonBoundAction::Pause).matches_frame_events()) {
     handle_menu_selection("CANCEL");
@@ -243,6 +250,13 @@ bool PauseMenuMode::handle_input() {
 void PauseMenuMode::handle_menu_selection(const std::string& item) {
   if (item == "resume" or item == "CANCEL") {
     Globals::mode_stack->next_frame_pop_mode();
+  } else if ((item == "checkpoint" or item == "restart") and _gameplay_mode) {
+    if (item == "checkpoint") {
+      _gameplay_mode->restore_checkpoint();
+    } else {
+      _gameplay_mode->restart();
+    }
+    Globals::mode_stack->next_frame_pop_mode();
   } else if (item == "options") {
     Globals::mode_stack->next_frame_push_mode(boost::shared_ptr<Mode>(new OptionsMenuMode(false)));
   } else if (item == "quit") {
@@ -254,10 +268,19 @@ void PauseMenuMode::handle_menu_selection(const std::string& item) {
 
 PostMissionMenuMode::PostMissionMenuMode(bool won) : SimpleMenuMode(false, 400, 40, 30), _won(won) {
   add_entry("continue", won ? "Rios made it!" : "Didn't make it...");
+  add_entry("retry", "Try Again");
+}
+
+void PostMissionMenuMode::prior_top(const boost::shared_ptr<Mode>& m) {
+  _gameplay_mode = boost::dynamic_pointer_cast<GameplayMode>(m);
 }
 
 void PostMissionMenuMode::handle_menu_selection(const std::string& item) {
-  if (item == "continue") {
+  if (item == "retry" and _gameplay_mode) {
+    // Only pop this mode, going straight back into the same GameplayMode after it's been restarted
+    _gameplay_mode->restart();
+    Globals::mode_stack->next_frame_pop_mode();
+  } else if (item == "continue") {
     // Pop both this mode and the GameplayMode, returning us to the pre-mission screen
     Globals::mode_stack->next_frame_pop_mode();
     Globals::mode_stack->next_frame_pop_mode();
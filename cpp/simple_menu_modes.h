@@ -32,6 +32,8 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #include "gui.h"
 #include "mode.h"
 
+class GameplayMode;
+
 class SimpleMenuMode : public Mode {
   private:
     bool _draw_background;
@@ -81,23 +83,29 @@ class MissionSelectMenuMode : public SimpleMenuMode {
 };
 
 class PauseMenuMode : public SimpleMenuMode {
+  private:
+    boost::shared_ptr<GameplayMode> _gameplay_mode;
+  
   public:
     bool execute_after_lower_mode() { return true; }
     
     PauseMenuMode();
     bool handle_input();
     void handle_menu_selection(const std::string& item);
+    void prior_top(const boost::shared_ptr<Mode>& m);
 };
 
 class PostMissionMenuMode : public SimpleMenuMode {
   private:
     bool _won;
+    boost::shared_ptr<GameplayMode> _gameplay_mode;
 
   public:
     bool execute_after_lower_mode() { return true; }
 
     PostMissionMenuMode(bool won);
     void handle_menu_selection(const std::string& item);
+    void prior_top(const boost::shared_ptr<Mode>& m);
 };
 
 #endif
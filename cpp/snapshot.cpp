@@ -0,0 +1,102 @@
+/*
+snapshot.cpp: Implementation for the SnapshotBuffer and WorldSnapshot classes.
+WorldSnapshot captures the dynamic state of the current mission so that it can be restored later without reloading anything.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <boost/format.hpp>
+
+#include "debug.h"
+#include "gameobj.h"
+#include "globals.h"
+#include "mission_fsm.h"
+#include "sim.h"
+#include "snapshot.h"
+#include "streaming.h"
+#include "trigger.h"
+
+void SnapshotBuffer::write(const std::string& s) {
+  write((unsigned int)s.size());
+  _data.insert(_data.end(), s.begin(), s.end());
+}
+
+void SnapshotBuffer::read(std::string& s) {
+  unsigned int len;
+  read(len);
+  if (_read_pos + len > _data.size()) {
+    throw GameException("Attempted to read past the end of a snapshot");
+  }
+  s.assign(&_data[0] + _read_pos, len);
+  _read_pos += len;
+}
+
+void WorldSnapshot::capture(const MissionFSM& fsm) {
+  _buf.clear();
+  _gameobj_count = 0;
+  
+  _buf.write(Globals::total_steps);
+  _buf.write(Sim::get_origin_offset());
+  
+  // Streamed scenery never changes, and which of it is loaded depends only on where the avatar is
+  for (GOMap::const_iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
+    if (!Streaming::is_streamed(i->first)) {
+      i->second->save_state(_buf);
+      ++_gameobj_count;
+    }
+  }
+  fsm.save_state(_buf);
+  
+  Debug::debug_msg((boost::format("Captured world snapshot at step %u, %u bytes") % Globals::total_steps % _buf.size()).str());
+}
+
+void WorldSnapshot::restore(MissionFSM& fsm) {
+  if (!is_valid()) {
+    throw GameException("Attempted to restore an empty world snapshot");
+  }
+  unsigned int gameobj_count = 0;
+  for (GOMap::const_iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
+    if (!Streaming::is_streamed(i->first)) {
+      ++gameobj_count;
+    }
+  }
+  if (gameobj_count != _gameobj_count) {
+    throw GameException("Attempted to restore a world snapshot into a different mission");
+  }
+  
+  _buf.rewind();
+  _buf.read(Globals::total_steps);
+  
+  // Bodies are restored relative to the origin as it was, and static geoms and triggers have to be moved back there too
+  Vector origin;
+  _buf.read(origin);
+  Sim::rebase_origin(origin - Sim::get_origin_offset());
+  
+  for (GOMap::iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
+    if (!Streaming::is_streamed(i->first)) {
+      i->second->restore_state(_buf);
+    }
+  }
+  fsm.restore_state(_buf);
+  
+  // Contacts and trigger occupancy from the abandoned timeline mustn't leak into the restored one
+  Sim::forget_contacts();
+  Triggers::resync();
+  
+  Debug::debug_msg((boost::format("Restored world snapshot to step %u") % Globals::total_steps).str());
+}
@@ -0,0 +1,88 @@
+/*
+snapshot.h: Header for the SnapshotBuffer and WorldSnapshot classes.
+WorldSnapshot captures the dynamic state of the current mission so that it can be restored later without reloading anything.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#ifndef ORBIT_RIBBON_SNAPSHOT_H
+#define ORBIT_RIBBON_SNAPSHOT_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "except.h"
+#include "geometry.h"
+
+class MissionFSM;
+
+// A flat buffer of plain values, which must be read back in the same order they were written
+// Snapshots only ever live in memory for the current run, so there's no need to worry about byte order
+class SnapshotBuffer {
+  public:
+    SnapshotBuffer() : _read_pos(0) {}
+    
+    template <typename T> void write(const T& v) {
+      const char* p = reinterpret_cast<const char*>(&v);
+      _data.insert(_data.end(), p, p + sizeof(T));
+    }
+    
+    template <typename T> void read(T& v) {
+      if (_read_pos + sizeof(T) > _data.size()) {
+        throw GameException("Attempted to read past the end of a snapshot");
+      }
+      std::memcpy(&v, &_data[_read_pos], sizeof(T));
+      _read_pos += sizeof(T);
+    }
+    
+    void write(const Point& p) { write(p.x); write(p.y); write(p.z); }
+    void read(Point& p) { read(p.x); read(p.y); read(p.z); }
+    
+    void write(const std::string& s);
+    void read(std::string& s);
+    
+    void clear() { _data.clear(); _read_pos = 0; }
+    void rewind() { _read_pos = 0; }
+    bool empty() const { return _data.empty(); }
+    unsigned int size() const { return _data.size(); }
+    const char* data() const { return _data.empty() ? 0 : &_data[0]; }
+  
+  private:
+    std::vector<char> _data;
+    unsigned int _read_pos;
+};
+
+// The state of every GameObj, the mission FSM, and the step counter at one moment
+// A snapshot can only be restored into the same loaded mission that it was captured from.
+class WorldSnapshot {
+  public:
+    WorldSnapshot() : _gameobj_count(0) {}
+    
+    bool is_valid() const { return !_buf.empty(); }
+    void clear() { _buf.clear(); _gameobj_count = 0; }
+    
+    void capture(const MissionFSM& fsm);
+    void restore(MissionFSM& fsm);
+  
+  private:
+    SnapshotBuffer _buf;
+    unsigned int _gameobj_count;
+};
+
+#endif
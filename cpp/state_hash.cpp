@@ -0,0 +1,170 @@
+/*
+state_hash.cpp: Implementation for the StateHash class.
+This class hashes the simulation state every step, to check that separate runs stay identical, and can log body trajectories.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+#include "debug.h"
+#include "except.h"
+#include "gameobj.h"
+#include "globals.h"
+#include "mission_fsm.h"
+#include "sim.h"
+#include "snapshot.h"
+#include "state_hash.h"
+#include "streaming.h"
+
+const boost::uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const boost::uint64_t FNV_PRIME = 1099511628211ULL;
+
+boost::scoped_ptr<std::ofstream> StateHash::_log;
+boost::scoped_ptr<std::ofstream> StateHash::_trajectory;
+boost::scoped_ptr<std::ifstream> StateHash::_reference;
+unsigned int StateHash::_steps_compared = 0;
+bool StateHash::_diverged = false;
+
+// Kept around between steps so that the state buffer isn't reallocated every time
+SnapshotBuffer hash_buf;
+
+std::string hash_to_str(boost::uint64_t h) {
+  char s[17];
+  std::sprintf(s, "%016llx", (unsigned long long)h);
+  return std::string(s);
+}
+
+boost::uint64_t StateHash::hash_world(const MissionFSM& fsm) {
+  // Saved GameObj state includes the ODE body positions, rotations, and velocities at full precision
+  hash_buf.clear();
+  hash_buf.write(Globals::total_steps);
+  hash_buf.write(Sim::get_origin_offset());
+  for (GOMap::const_iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
+    if (!Streaming::is_streamed(i->first)) {
+      i->second->save_state(hash_buf);
+    }
+  }
+  fsm.save_state(hash_buf);
+  
+  boost::uint64_t h = FNV_OFFSET_BASIS;
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(hash_buf.data());
+  for (unsigned int i = 0; i < hash_buf.size(); ++i) {
+    h ^= p[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+void StateHash::set_log_path(const boost::filesystem::path& path) {
+  _log.reset(new std::ofstream(path.string().c_str(), std::ios::out | std::ios::trunc));
+  if (!_log->good()) {
+    _log.reset();
+    throw GameException("Unable to open " + path.string() + " for hash logging");
+  }
+  Debug::status_msg("Logging per-step state hashes to " + path.string());
+}
+
+void StateHash::set_compare_path(const boost::filesystem::path& path) {
+  _reference.reset(new std::ifstream(path.string().c_str(), std::ios::in));
+  if (!_reference->good()) {
+    _reference.reset();
+    throw GameException("Unable to open hash log " + path.string() + " for comparison");
+  }
+  _steps_compared = 0;
+  _diverged = false;
+  Debug::status_msg("Comparing per-step state hashes against " + path.string());
+}
+
+void StateHash::set_trajectory_path(const boost::filesystem::path& path) {
+  _trajectory.reset(new std::ofstream(path.string().c_str(), std::ios::out | std::ios::trunc));
+  if (!_trajectory->good()) {
+    _trajectory.reset();
+    throw GameException("Unable to open " + path.string() + " for trajectory logging");
+  }
+  _trajectory->precision(9);
+  Debug::status_msg("Logging per-step body trajectories to " + path.string());
+}
+
+void StateHash::step(const MissionFSM& fsm) {
+  if (_trajectory) {
+    // Positions are logged in area coordinates, so that runs which moved the origin at different times still line up
+    const Vector& origin = Sim::get_origin_offset();
+    for (GOMap::const_iterator i = Globals::gameobjs.begin(); i != Globals::gameobjs.end(); ++i) {
+      const GameObj& obj = *(i->second);
+      if (obj.has_body()) {
+        const Point& p = obj.get_pos();
+        const Vector& v = obj.get_vel();
+        *_trajectory << Globals::total_steps << " " << double(p.x) + origin.x << " " << double(p.y) + origin.y << " " << double(p.z) + origin.z << " " << v.x << " " << v.y << " " << v.z << " " << i->first << "\n";
+      }
+    }
+  }
+  
+  if (!_log and !_reference) {
+    return;
+  }
+  
+  boost::uint64_t h = hash_world(fsm);
+  
+  if (_log) {
+    *_log << Globals::total_steps << " " << hash_to_str(h) << "\n";
+  }
+  
+  if (_reference and !_diverged) {
+    std::string line;
+    if (!std::getline(*_reference, line)) {
+      Debug::status_msg((boost::format("Hash reference ended after %u steps, stopping comparison") % _steps_compared).str());
+      _reference.reset();
+      return;
+    }
+    
+    std::istringstream ss(line);
+    unsigned int ref_step;
+    unsigned long long ref_hash;
+    ss >> ref_step >> std::hex >> ref_hash;
+    if (ss.fail()) {
+      throw GameException("Malformed line in hash reference: " + line);
+    }
+    
+    if (ref_step != Globals::total_steps or ref_hash != h) {
+      _diverged = true;
+      Debug::error_msg((boost::format("State diverged from reference at step %u (reference has step %u hash %s, this run has %s)")
+        % Globals::total_steps % ref_step % hash_to_str(ref_hash) % hash_to_str(h)
+      ).str());
+    } else {
+      ++_steps_compared;
+    }
+  }
+}
+
+void StateHash::finish() {
+  if (_reference or _diverged) {
+    if (_diverged) {
+      Debug::status_msg((boost::format("Hash comparison: %u steps matched before divergence") % _steps_compared).str());
+    } else {
+      Debug::status_msg((boost::format("Hash comparison: all %u steps matched") % _steps_compared).str());
+    }
+  }
+  _reference.reset();
+  _log.reset();
+  _trajectory.reset();
+}
@@ -0,0 +1,66 @@
+/*
+state_hash.h: Header for the StateHash class.
+This class hashes the simulation state every step, to check that separate runs stay identical, and can log body trajectories.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#ifndef ORBIT_RIBBON_STATE_HASH_H
+#define ORBIT_RIBBON_STATE_HASH_H
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <fstream>
+
+class App;
+class GameplayMode;
+class MissionFSM;
+
+// Hash logs are text files with one "step hash" line per simulated step
+// Comparing against a log made by an earlier run reports the first step where the two runs differ.
+class StateHash {
+  public:
+    // FNV-1a hash of the exact bits of every GameObj's saved state, the mission FSM state, and the step number
+    static boost::uint64_t hash_world(const MissionFSM& fsm);
+  
+  private:
+    friend class App;
+    friend class GameplayMode;
+    
+    static boost::scoped_ptr<std::ofstream> _log;
+    static boost::scoped_ptr<std::ofstream> _trajectory;
+    static boost::scoped_ptr<std::ifstream> _reference;
+    static unsigned int _steps_compared;
+    static bool _diverged;
+    
+    static void set_log_path(const boost::filesystem::path& path);
+    static void set_compare_path(const boost::filesystem::path& path);
+    
+    // Trajectory logs have a "step x y z vx vy vz name" line for each dynamic body each step
+    // Unlike hashes, these can be compared between builds that aren't expected to be identical, e.g. single and double precision
+    static void set_trajectory_path(const boost::filesystem::path& path);
+    
+    // Called at the start of each gameplay step; does nothing unless logging or comparing
+    static void step(const MissionFSM& fsm);
+    
+    // Reports the comparison result and closes the files
+    static void finish();
+};
+
+#endif
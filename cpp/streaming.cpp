@@ -0,0 +1,406 @@
+/*
+streaming.cpp: Implementation for the Streaming class.
+This class loads the static objects of large areas in and out by spatial cell as the avatar moves around.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+
+#include "autoxsd/orepkgdesc.h"
+#include "debug.h"
+#include "gameobj.h"
+#include "globals.h"
+#include "mesh.h"
+#include "ore.h"
+#include "sim.h"
+#include "streaming.h"
+
+// Width of each cubic cell in meters
+const float STREAM_CELL_SIZE = 2000;
+
+// Cells within this many cells (along every axis) of the focus or lookahead point are loaded
+const int STREAM_LOAD_RADIUS = 1;
+
+// Loaded cells are only unloaded once they're further than this, so that going back and forth over a cell boundary doesn't thrash
+const int STREAM_UNLOAD_RADIUS = 2;
+
+// How far ahead along the avatar's velocity to look for cells to bring in
+const float STREAM_LOOKAHEAD_SECS = 4;
+
+// The most streamed GameObjs that will be created in one simulation step
+const unsigned int STREAM_OBJS_PER_STEP = 4;
+
+// How many simulation steps a newly wanted cell gives the prefetch thread before its objects start being created
+// If the thread hasn't caught up by then the main thread waits for it, so a replay creates objects on the same steps
+const unsigned int STREAM_PREFETCH_LEAD_STEPS = 30;
+
+Streaming::CellMap Streaming::_cells;
+std::set<std::string> Streaming::_streamed_names;
+unsigned int Streaming::_resident_count = 0;
+bool Streaming::_enabled = false;
+Streaming::CellKey Streaming::_focus_cell;
+Streaming::CellKey Streaming::_lookahead_cell;
+unsigned int Streaming::_step_count = 0;
+std::deque<Streaming::CellKey> Streaming::_loading;
+boost::scoped_ptr<boost::thread> Streaming::_prefetch_thread;
+boost::mutex Streaming::_prefetch_mutex;
+boost::condition_variable Streaming::_prefetch_cond;
+boost::condition_variable Streaming::_prefetch_done_cond;
+std::deque<std::string> Streaming::_prefetch_queue;
+std::map<std::string, boost::shared_ptr<PreparedMeshFile> > Streaming::_prefetched;
+bool Streaming::_stopping = false;
+
+bool Streaming::CellKey::operator<(const CellKey& other) const {
+  if (x != other.x) { return x < other.x; }
+  if (y != other.y) { return y < other.y; }
+  return z < other.z;
+}
+
+// Distance between two cells in cells, along whichever axis they're furthest apart
+int cell_dist(int ax, int ay, int az, int bx, int by, int bz) {
+  return std::max(std::abs(ax - bx), std::max(std::abs(ay - by), std::abs(az - bz)));
+}
+
+void Streaming::init() {
+  _stopping = false;
+  _prefetch_thread.reset(new boost::thread(&Streaming::prefetch_loop));
+}
+
+void Streaming::deinit() {
+  {
+    boost::lock_guard<boost::mutex> lock(_prefetch_mutex);
+    _stopping = true;
+  }
+  _prefetch_cond.notify_all();
+  _prefetch_done_cond.notify_all();
+  if (_prefetch_thread) {
+    _prefetch_thread->join();
+    _prefetch_thread.reset();
+  }
+  clear();
+}
+
+void Streaming::clear() {
+  _cells.clear();
+  _streamed_names.clear();
+  _resident_count = 0;
+  _enabled = false;
+  _step_count = 0;
+  _loading.clear();
+  
+  boost::lock_guard<boost::mutex> lock(_prefetch_mutex);
+  _prefetch_queue.clear();
+  _prefetched.clear();
+}
+
+Streaming::CellKey Streaming::cell_for(const Point& p) {
+  CellKey key;
+  key.x = int(std::floor(p.x/STREAM_CELL_SIZE));
+  key.y = int(std::floor(p.y/STREAM_CELL_SIZE));
+  key.z = int(std::floor(p.z/STREAM_CELL_SIZE));
+  return key;
+}
+
+std::string Streaming::mesh_file(const ORE1::ObjType& obj) {
+  // Matches the name MeshGameObj loads its animation from
+  return std::string("mesh-") + obj.dataName();
+}
+
+void Streaming::load(const std::vector<const ORE1::ObjType*>& objs) {
+  clear();
+  
+  // Without an avatar there's nothing to stream around, so then everything is loaded right away
+  const ORE1::ObjType* avatar = 0;
+  BOOST_FOREACH(const ORE1::ObjType* obj, objs) {
+    if (obj->implName() == "Avatar") {
+      avatar = obj;
+      break;
+    }
+  }
+  
+  BOOST_FOREACH(const ORE1::ObjType* obj, objs) {
+    if (avatar and obj->implName() == "") {
+      _cells[cell_for(Point(obj->pos()[0], obj->pos()[1], obj->pos()[2]))].objs.push_back(obj);
+      _streamed_names.insert(obj->objName());
+    } else {
+      instantiate(*obj);
+    }
+  }
+  
+  if (avatar and !_cells.empty()) {
+    _enabled = true;
+    _focus_cell = cell_for(Point(avatar->pos()[0], avatar->pos()[1], avatar->pos()[2]));
+    _lookahead_cell = _focus_cell;
+    update_wanted(true);
+    Debug::status_msg((boost::format("Streaming %u scenery objects in %u cells, %u loaded at start")
+      % _streamed_names.size() % _cells.size() % _resident_count
+    ).str());
+  }
+}
+
+void Streaming::step(const Point& focus, const Vector& vel) {
+  if (!_enabled) {
+    return;
+  }
+  
+  ++_step_count;
+  CellKey focus_cell = cell_for(focus);
+  CellKey lookahead_cell = cell_for(focus + vel*STREAM_LOOKAHEAD_SECS);
+  if (!(focus_cell == _focus_cell) or !(lookahead_cell == _lookahead_cell)) {
+    _focus_cell = focus_cell;
+    _lookahead_cell = lookahead_cell;
+    update_wanted(false);
+  }
+  
+  unsigned int budget = STREAM_OBJS_PER_STEP;
+  while (budget > 0 and !_loading.empty()) {
+    CellKey key = _loading.front();
+    Cell& cell = _cells[key];
+    
+    // The avatar's own cell can't wait around for the prefetch thread
+    bool force = key == _focus_cell;
+    if (cell.wanted and !force and _step_count < cell.load_after) {
+      break;
+    }
+    if (!cell.wanted or load_from_cell(cell, force, budget)) {
+      cell.queued = false;
+      _loading.pop_front();
+    } else {
+      break;
+    }
+  }
+}
+
+void Streaming::update_wanted(bool immediate) {
+  for (CellMap::iterator i = _cells.begin(); i != _cells.end(); ++i) {
+    i->second.wanted = false;
+  }
+  
+  want_around(_focus_cell, immediate);
+  want_around(_lookahead_cell, immediate);
+  
+  for (CellMap::iterator i = _cells.begin(); i != _cells.end(); ++i) {
+    Cell& cell = i->second;
+    if (cell.wanted or (cell.loaded_count == 0 and !cell.prefetching)) {
+      continue;
+    }
+    
+    const CellKey& k = i->first;
+    if (
+      cell_dist(k.x, k.y, k.z, _focus_cell.x, _focus_cell.y, _focus_cell.z) > STREAM_UNLOAD_RADIUS and
+      cell_dist(k.x, k.y, k.z, _lookahead_cell.x, _lookahead_cell.y, _lookahead_cell.z) > STREAM_UNLOAD_RADIUS
+    ) {
+      unload_cell(cell);
+    }
+  }
+}
+
+void Streaming::want_around(const CellKey& center, bool immediate) {
+  // The center goes first so that it's at the front of the loading queue
+  want_cell(center, immediate);
+  for (int dx = -STREAM_LOAD_RADIUS; dx <= STREAM_LOAD_RADIUS; ++dx) {
+    for (int dy = -STREAM_LOAD_RADIUS; dy <= STREAM_LOAD_RADIUS; ++dy) {
+      for (int dz = -STREAM_LOAD_RADIUS; dz <= STREAM_LOAD_RADIUS; ++dz) {
+        CellKey key;
+        key.x = center.x + dx;
+        key.y = center.y + dy;
+        key.z = center.z + dz;
+        want_cell(key, immediate);
+      }
+    }
+  }
+}
+
+void Streaming::want_cell(const CellKey& key, bool immediate) {
+  CellMap::iterator i = _cells.find(key);
+  if (i == _cells.end()) {
+    return;
+  }
+  
+  Cell& cell = i->second;
+  cell.wanted = true;
+  if (cell.resident) {
+    return;
+  }
+  
+  if (immediate) {
+    unsigned int budget = std::numeric_limits<unsigned int>::max();
+    load_from_cell(cell, true, budget);
+  } else if (!cell.queued) {
+    cell.queued = true;
+    cell.load_after = _step_count + STREAM_PREFETCH_LEAD_STEPS;
+    _loading.push_back(key);
+    if (!cell.prefetching) {
+      cell.prefetching = true;
+      for (unsigned int n = cell.loaded_count; n < cell.objs.size(); ++n) {
+        request_prefetch(mesh_file(*cell.objs[n]));
+      }
+    }
+  }
+}
+
+bool Streaming::load_from_cell(Cell& cell, bool force, unsigned int& budget) {
+  while (cell.loaded_count < cell.objs.size()) {
+    const ORE1::ObjType& obj = *cell.objs[cell.loaded_count];
+    if (budget == 0) {
+      return false;
+    }
+    
+    // Forced loads read the file themselves if it isn't ready, and otherwise the object is created whether or not
+    // the prefetch thread has finished, so that only the simulation decides on which step it appears
+    if (!force) {
+      wait_for_prefetch(mesh_file(obj));
+    }
+    instantiate(obj);
+    ++cell.loaded_count;
+    --budget;
+  }
+  
+  // Objects sharing a mesh only use up the first prefetched copy, and the rest mustn't be left lying around
+  if (cell.prefetching) {
+    BOOST_FOREACH(const ORE1::ObjType* obj, cell.objs) {
+      discard_prefetched(mesh_file(*obj));
+    }
+    cell.prefetching = false;
+  }
+  
+  if (!cell.resident) {
+    cell.resident = true;
+    ++_resident_count;
+  }
+  return true;
+}
+
+void Streaming::unload_cell(Cell& cell) {
+  for (unsigned int n = 0; n < cell.loaded_count; ++n) {
+    Globals::gameobjs.erase(cell.objs[n]->objName());
+  }
+  cell.loaded_count = 0;
+  
+  if (cell.prefetching) {
+    BOOST_FOREACH(const ORE1::ObjType* obj, cell.objs) {
+      discard_prefetched(mesh_file(*obj));
+    }
+    cell.prefetching = false;
+  }
+  
+  if (cell.resident) {
+    cell.resident = false;
+    --_resident_count;
+  }
+}
+
+void Streaming::instantiate(const ORE1::ObjType& obj) {
+  boost::shared_ptr<GameObj> gameobj = get_factory<GameObjFactorySpec>().create(obj);
+  
+  // ObjTypes are in area coordinates, but the simulation origin may have moved away from the area origin by now
+  gameobj->rebase(Sim::get_origin_offset());
+  Globals::gameobjs.insert(GOMap::value_type(obj.objName(), gameobj));
+}
+
+void Streaming::request_prefetch(const std::string& file) {
+  {
+    boost::lock_guard<boost::mutex> lock(_prefetch_mutex);
+    if (_prefetched.count(file) > 0) {
+      return;
+    }
+    _prefetched[file].reset();
+    _prefetch_queue.push_back(file);
+  }
+  _prefetch_cond.notify_one();
+}
+
+void Streaming::discard_prefetched(const std::string& file) {
+  boost::lock_guard<boost::mutex> lock(_prefetch_mutex);
+  _prefetched.erase(file);
+}
+
+void Streaming::wait_for_prefetch(const std::string& file) {
+  boost::unique_lock<boost::mutex> lock(_prefetch_mutex);
+  while (!_stopping) {
+    std::map<std::string, boost::shared_ptr<PreparedMeshFile> >::const_iterator i = _prefetched.find(file);
+    if (i == _prefetched.end() or i->second) {
+      return;
+    }
+    _prefetch_done_cond.wait(lock);
+  }
+}
+
+bool Streaming::take_prefetched(const std::string& file, boost::shared_ptr<PreparedMeshFile>& data) {
+  boost::lock_guard<boost::mutex> lock(_prefetch_mutex);
+  std::map<std::string, boost::shared_ptr<PreparedMeshFile> >::iterator i = _prefetched.find(file);
+  if (i == _prefetched.end() or !i->second) {
+    return false;
+  }
+  data = i->second;
+  _prefetched.erase(i);
+  return true;
+}
+
+void Streaming::prefetch_loop() {
+  boost::unique_lock<boost::mutex> lock(_prefetch_mutex);
+  while (true) {
+    while (_prefetch_queue.empty() and !_stopping) {
+      _prefetch_cond.wait(lock);
+    }
+    if (_stopping) {
+      return;
+    }
+    
+    std::string file = _prefetch_queue.front();
+    _prefetch_queue.pop_front();
+    if (_prefetched.count(file) == 0) {
+      continue; // Discarded while it was waiting in the queue
+    }
+    
+    // Each OreFileHandle opens the package separately, so reading here doesn't disturb the main thread's handles
+    // Parsing, vertex cache reordering and LOD generation all happen here too, leaving only the GL work for the main thread
+    lock.unlock();
+    boost::shared_ptr<PreparedMeshFile> data;
+    try {
+      boost::shared_ptr<OreFileHandle> fh = Globals::ore->get_fh(file);
+      std::string text(fh->uncompressed_size(), '\0');
+      if (!text.empty()) {
+        fh->read(&text[0], text.size());
+      }
+      std::istringstream is(text);
+      data = MeshAnimation::prepare(is, false);
+    } catch (const std::exception& e) {
+      // The main thread will try again itself, and report the problem then
+      data.reset();
+    }
+    lock.lock();
+    
+    std::map<std::string, boost::shared_ptr<PreparedMeshFile> >::iterator i = _prefetched.find(file);
+    if (i != _prefetched.end()) {
+      if (data) {
+        i->second = data;
+      } else {
+        _prefetched.erase(i);
+      }
+    }
+    _prefetch_done_cond.notify_all();
+  }
+}
@@ -0,0 +1,129 @@
+/*
+streaming.h: Header for the Streaming class.
+This class loads the static objects of large areas in and out by spatial cell as the avatar moves around.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#ifndef ORBIT_RIBBON_STREAMING_H
+#define ORBIT_RIBBON_STREAMING_H
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+
+namespace ORE1 { class ObjType; }
+class App;
+class GameplayMode;
+struct PreparedMeshFile;
+
+// Scenery objects (those without an implName) are sorted into cubic cells when a mission is loaded, and only
+// the cells near the avatar and near where it's headed have their GameObjs in Globals::gameobjs.
+// Mesh files for cells about to come in are read out of the ORE package and prepared on a background thread; the
+// GameObjs themselves, and their geoms and GL buffers, are always created on the main thread a few at a time.
+// Everything else, and everything when there's no avatar, is loaded up front as before.
+class Streaming {
+  public:
+    // Returns true if the named GameObj is streamed scenery, which snapshots and state hashes leave out
+    static bool is_streamed(const std::string& name) { return _streamed_names.count(name) > 0; }
+    
+    // If the background thread has finished reading and preparing the given mesh file, hands it over and returns true
+    static bool take_prefetched(const std::string& file, boost::shared_ptr<PreparedMeshFile>& data);
+    
+    static unsigned int get_resident_cell_count() { return _resident_count; }
+    static unsigned int get_cell_count() { return _cells.size(); }
+  
+  private:
+    friend class App;
+    friend class GameplayMode;
+    
+    struct CellKey {
+      int x, y, z;
+      bool operator<(const CellKey& other) const;
+      bool operator==(const CellKey& other) const { return x == other.x and y == other.y and z == other.z; }
+    };
+    
+    struct Cell {
+      std::vector<const ORE1::ObjType*> objs;
+      bool wanted;
+      bool queued; // In _loading
+      bool prefetching; // Mesh files have been requested from the prefetch thread
+      bool resident; // Every object has been instantiated
+      unsigned int loaded_count; // How many of objs have been instantiated so far
+      unsigned int load_after; // The step number at which a queued cell starts loading
+      Cell() : wanted(false), queued(false), prefetching(false), resident(false), loaded_count(0), load_after(0) {}
+    };
+    
+    typedef std::map<CellKey, Cell> CellMap;
+    static CellMap _cells;
+    static std::set<std::string> _streamed_names;
+    static unsigned int _resident_count;
+    
+    // The cells around the focus and around the lookahead point, as of the last update
+    static bool _enabled;
+    static CellKey _focus_cell;
+    static CellKey _lookahead_cell;
+    
+    // Simulation steps since the mission was loaded, so that when streamed objects appear doesn't depend on the prefetch thread
+    static unsigned int _step_count;
+    
+    // Cells which are wanted but not yet fully loaded, nearest first
+    static std::deque<CellKey> _loading;
+    
+    // Shared with the prefetch thread; an empty pointer in _prefetched means the file is queued but not read yet
+    static boost::scoped_ptr<boost::thread> _prefetch_thread;
+    static boost::mutex _prefetch_mutex;
+    static boost::condition_variable _prefetch_cond;
+    static boost::condition_variable _prefetch_done_cond;
+    static std::deque<std::string> _prefetch_queue;
+    static std::map<std::string, boost::shared_ptr<PreparedMeshFile> > _prefetched;
+    static bool _stopping;
+    
+    static void init();
+    static void deinit();
+    
+    // Creates the GameObjs for the given objects, immediately for anything not streamed and for the cells around the avatar
+    static void load(const std::vector<const ORE1::ObjType*>& objs);
+    
+    // Brings cells in and out around focus, which is in area coordinates, and around where vel will take it shortly
+    static void step(const Point& focus, const Vector& vel);
+    
+    static void clear();
+    static CellKey cell_for(const Point& p);
+    static void update_wanted(bool immediate);
+    static void want_around(const CellKey& center, bool immediate);
+    static void want_cell(const CellKey& key, bool immediate);
+    static void unload_cell(Cell& cell);
+    static bool load_from_cell(Cell& cell, bool force, unsigned int& budget);
+    static void instantiate(const ORE1::ObjType& obj);
+    
+    static std::string mesh_file(const ORE1::ObjType& obj);
+    static void request_prefetch(const std::string& file);
+    static void discard_prefetched(const std::string& file);
+    static void wait_for_prefetch(const std::string& file);
+    static void prefetch_loop();
+};
+
+#endif
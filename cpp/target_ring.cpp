@@ -22,32 +22,38 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 
 #include "target_ring.h"
 
+#include <boost/array.hpp>
+#include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
 
 #include "autoxsd/orepkgdesc.h"
 #include "constants.h"
 #include "globals.h"
 #include "mesh.h"
+#include "mission_events.h"
+#include "render_queue.h"
+#include "snapshot.h"
 
 AutoRegistration<GameObjFactorySpec, TargetRingGameObj> target_ring_gameobj_reg("TargetRing");
 
-bool TargetRingGameObj::CheckFaceContactHandler::handle_collision(
-  float t __attribute__ ((unused)),
-  dGeomID o __attribute__ ((unused)),
-  const dContactGeom* c __attribute__ ((unused)),
-  unsigned int c_len  __attribute__ ((unused))
-) {
-  // TODO Only care about runners that pass through the ring, not other objects (use ODE bitfield)
-  // TODO Use a pair for the map key to track both check face and the object that triggered it
-  _target_ring->_check_face_collision_times[this] = Globals::total_steps;
+// Returns the product of the column-major 3x3 rotation matrix and the vector
+Vector rotate_vector(const boost::array<float, 9>& rot, const Vector& v) {
+  return Vector(
+    rot[0]*v.x + rot[3]*v.y + rot[6]*v.z,
+    rot[1]*v.x + rot[4]*v.y + rot[7]*v.z,
+    rot[2]*v.x + rot[5]*v.y + rot[8]*v.z
+  );
+}
 
-  // This geom is never used to create contact joints
-  return false;
+void TargetRingGameObj::handle_trigger_event(const TriggerEvent& e) {
+  // TODO Use a pair for the map key to track both check face and the object that triggered it
+  _check_face_collision_times[e.volume] = e.step;
 }
 
 void TargetRingGameObj::step_impl() { 
   // Destroy any non-recent collisions
-  for (std::map<CheckFaceContactHandler*, unsigned int>::iterator i = _check_face_collision_times.begin(); i != _check_face_collision_times.end();) {
+  for (std::map<const TriggerVolume*, unsigned int>::iterator i = _check_face_collision_times.begin(); i != _check_face_collision_times.end();) {
     if ((Globals::total_steps - i->second)/(float)MAX_FPS > CHECK_FACE_MAX_COLLISION_AGE) {
       _check_face_collision_times.erase(i++);
     } else {
@@ -56,15 +62,59 @@ void TargetRingGameObj::step_impl() {
   }
   
   if (_passed) { return; }
-
+  
   // If we have a recent collision on every check face, then we can consider that a ring passthru
   if (_check_face_collision_times.size() == CHECK_FACE_COUNT) {
-    _passed = true;
+    set_passed(true);
+  }
+}
+
+void TargetRingGameObj::save_state_impl(SnapshotBuffer& buf) const {
+  buf.write(_passed);
+  
+  // Volumes are identified by their index, since their addresses are only meaningful to this run
+  BOOST_FOREACH(const boost::shared_ptr<TriggerVolume>& face, _check_faces) {
+    std::map<const TriggerVolume*, unsigned int>::const_iterator i = _check_face_collision_times.find(face.get());
+    buf.write(i != _check_face_collision_times.end());
+    buf.write(i != _check_face_collision_times.end() ? i->second : 0u);
+  }
+}
+
+void TargetRingGameObj::restore_state_impl(SnapshotBuffer& buf) {
+  bool passed;
+  buf.read(passed);
+  set_passed(passed);
+  
+  _check_face_collision_times.clear();
+  BOOST_FOREACH(const boost::shared_ptr<TriggerVolume>& face, _check_faces) {
+    bool recent;
+    unsigned int step;
+    buf.read(recent);
+    buf.read(step);
+    if (recent) {
+      _check_face_collision_times[face.get()] = step;
+    }
+  }
+}
+
+void TargetRingGameObj::set_passed(bool passed) {
+  if (passed != _passed) {
+    GameObjRegistry::adjust_counter(GameObjRegistry::RINGS_PASSED, passed ? 1 : -1);
+    MissionEvents::fire(MISSION_EVENT_RING_PASSED);
+    _passed = passed;
   }
 }
 
 void TargetRingGameObj::near_draw_impl() {
-  _mesh->draw();
+  _mesh->draw(RenderQueue::get_screen_radius(get_pos(), _mesh->get_bounding_radius()));
+}
+
+float TargetRingGameObj::get_bounding_radius() const {
+  return _mesh->get_bounding_radius();
+}
+
+RenderState TargetRingGameObj::get_render_state() const {
+  return _mesh->get_render_state();
 }
 
 TargetRingGameObj::TargetRingGameObj(const ORE1::ObjType& obj) :
@@ -72,17 +122,43 @@ TargetRingGameObj::TargetRingGameObj(const ORE1::ObjType& obj) :
   _passed(false),
   _mesh(MeshAnimation::load("mesh-LIBTargetRing"))
 {
-  // Set up geoms for our check faces
+  // Set up a plane-crossing trigger for each of our check faces
   for (unsigned int i = 1; i <= CHECK_FACE_COUNT; ++i) {
     std::string face_num_str = boost::lexical_cast<std::string>(i);
     const ORE1::ObjType& libscene_obj = get_libscene_obj("CheckFace" + face_num_str);
-    boost::shared_ptr<MeshAnimation> ma = MeshAnimation::load("mesh-" + libscene_obj.dataName()); // FIXME Duplicates code in mesh.cpp
-    _check_face_meshes.push_back(ma); // Keeps the MeshAnimation from being unloaded until the TargetRing is destroyed
-    get_entity().set_geom(
-      "check_face_" + face_num_str,
-      dCreateTriMesh(Sim::get_static_space(), ma->get_trimesh_data(0), 0, 0, 0),
-      std::auto_ptr<CollisionHandler>(new CheckFaceContactHandler(this)),
-      &libscene_obj
-    );
+    
+    // Find the extents of the check face in its own frame; the check faces are never drawn or collided with
+    float aabb[6];
+    CollisionMesh::load("mesh-" + libscene_obj.dataName())->get_aabb(aabb);
+    
+    Point local_center((aabb[0] + aabb[1])/2, (aabb[2] + aabb[3])/2, (aabb[4] + aabb[5])/2);
+    Vector half_extents((aabb[1] - aabb[0])/2, (aabb[3] - aabb[2])/2, (aabb[5] - aabb[4])/2);
+    
+    // The face is flat, so its thinnest axis is its normal, and the disc has to reach its farthest corner along the other two
+    Vector local_normal;
+    float radius;
+    if (half_extents.x <= half_extents.y && half_extents.x <= half_extents.z) {
+      local_normal = Vector(1, 0, 0);
+      radius = Vector(0, half_extents.y, half_extents.z).mag();
+    } else if (half_extents.y <= half_extents.z) {
+      local_normal = Vector(0, 1, 0);
+      radius = Vector(half_extents.x, 0, half_extents.z).mag();
+    } else {
+      local_normal = Vector(0, 0, 1);
+      radius = Vector(half_extents.x, half_extents.y, 0).mag();
+    }
+    
+    // The check face's position and rotation are relative to the ring
+    boost::array<float, 9> face_rot;
+    std::copy(libscene_obj.rot().begin(), libscene_obj.rot().end(), face_rot.begin());
+    Point face_pos(libscene_obj.pos()[0], libscene_obj.pos()[1], libscene_obj.pos()[2]);
+    Point center = get_pos() + rotate_vector(get_rot(), face_pos + rotate_vector(face_rot, local_center));
+    Vector normal = rotate_vector(get_rot(), rotate_vector(face_rot, local_normal));
+    
+    _check_faces.push_back(boost::shared_ptr<TriggerVolume>(new TriggerVolume(this, center, normal, radius)));
   }
 }
+
+TargetRingGameObj::~TargetRingGameObj() {
+  set_passed(false);
+}
@@ -24,11 +24,11 @@ along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
 #define ORBIT_RIBBON_TARGET_RING_H
 
 #include <boost/shared_ptr.hpp>
-#include <list>
 #include <map>
+#include <vector>
 
 #include "gameobj.h"
-#include "sim.h"
+#include "trigger.h"
 
 // Number of seconds before a collision with a check face is no longer considered recent enough to count
 // This way we can reduce the chance that the player can just whiff past both checkfaces from the outside
@@ -41,31 +41,30 @@ class MeshAnimation;
 namespace ORE1 { class ObjType; }
 
 class TargetRingGameObj;
-class TargetRingGameObj : public GameObj {
+class TargetRingGameObj : public GameObj, public TriggerListener {
   private:
-    class CheckFaceContactHandler;
-    friend class CheckFaceContactHandler;
-
     bool _passed;
     boost::shared_ptr<MeshAnimation> _mesh;
-    std::list<boost::shared_ptr<MeshAnimation> > _check_face_meshes;
-    std::map<CheckFaceContactHandler*, unsigned int> _check_face_collision_times;
+    std::vector<boost::shared_ptr<TriggerVolume> > _check_faces;
+    std::map<const TriggerVolume*, unsigned int> _check_face_collision_times;
     
-    class CheckFaceContactHandler : public SimpleContactHandler {
-      private:
-        TargetRingGameObj* _target_ring;
-
-      public:
-        CheckFaceContactHandler(TargetRingGameObj* target_ring) : _target_ring(target_ring) {}
-        bool handle_collision(float t, dGeomID o, const dContactGeom* c, unsigned int c_len);
-    };
-
+    // Keeps the registry's count of passed rings up to date
+    void set_passed(bool passed);
+  
   protected:
     void step_impl();
     void near_draw_impl();
-
+    void save_state_impl(SnapshotBuffer& buf) const;
+    void restore_state_impl(SnapshotBuffer& buf);
+  
   public:
     TargetRingGameObj(const ORE1::ObjType& obj);
+    ~TargetRingGameObj();
+    
+    float get_bounding_radius() const;
+    RenderState get_render_state() const;
+    
+    void handle_trigger_event(const TriggerEvent& e);
     
     bool passed() const { return _passed; }
 };
@@ -0,0 +1,211 @@
+/*
+trigger.cpp: Implementation of trigger volumes and the Triggers class.
+Trigger volumes report objects entering, leaving, or passing through them without going through contact generation.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <cmath>
+
+#include "gameobj.h"
+#include "globals.h"
+#include "trigger.h"
+
+std::vector<TriggerVolume*> Triggers::_volumes;
+std::vector<Triggers::Activator> Triggers::_activators;
+
+TriggerVolume::TriggerVolume(TriggerListener* listener, const Point& center, const boost::array<float, 9>& rot, const Vector& half_extents) :
+  _shape(BOX),
+  _listener(listener),
+  _center(center),
+  _rot(rot),
+  _half_extents(half_extents),
+  _radius(half_extents.mag())
+{
+  Triggers::add_volume(this);
+}
+
+TriggerVolume::TriggerVolume(TriggerListener* listener, const Point& center, float radius) :
+  _shape(SPHERE),
+  _listener(listener),
+  _center(center),
+  _radius(radius)
+{
+  Triggers::add_volume(this);
+}
+
+TriggerVolume::TriggerVolume(TriggerListener* listener, const Point& center, const Vector& normal, float radius) :
+  _shape(PLANE_CROSSING),
+  _listener(listener),
+  _center(center),
+  _normal(normal.to_length(1.0)),
+  _radius(radius)
+{
+  Triggers::add_volume(this);
+}
+
+TriggerVolume::~TriggerVolume() {
+  Triggers::remove_volume(this);
+}
+
+bool TriggerVolume::contains(const Point& p) const {
+  if (_shape == SPHERE) {
+    return p.sq_dist_to(_center) <= _radius*_radius;
+  } else if (_shape == BOX) {
+    // Bring the point into the box's frame by multiplying it with the transpose of the rotation
+    Vector d = p - _center;
+    for (unsigned int i = 0; i < 3; ++i) {
+      float local = d.x*_rot[i*3] + d.y*_rot[i*3 + 1] + d.z*_rot[i*3 + 2];
+      if (std::fabs(local) > _half_extents[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+bool TriggerVolume::crossed_by(const Point& a, const Point& b) const {
+  if (_shape != PLANE_CROSSING) {
+    return false;
+  }
+  
+  float da = _normal.dot_prod(a - _center);
+  float db = _normal.dot_prod(b - _center);
+  if ((da < 0) == (db < 0)) {
+    return false;
+  }
+  
+  if (_radius > 0) {
+    Point isect = a + (b - a)*(da/(da - db));
+    if (isect.sq_dist_to(_center) > _radius*_radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TriggerVolume::has_inside(const GameObj* activator) const {
+  return std::find(_inside.begin(), _inside.end(), activator) != _inside.end();
+}
+
+void TriggerVolume::notify(TriggerEvent::Type type, const GameObj* activator) {
+  TriggerEvent e;
+  e.type = type;
+  e.volume = this;
+  e.activator = activator;
+  e.step = Globals::total_steps;
+  _listener->handle_trigger_event(e);
+}
+
+void TriggerVolume::update(const GameObj* activator, const Point& from, const Point& to) {
+  if (_shape == PLANE_CROSSING) {
+    if (crossed_by(from, to)) {
+      notify(TriggerEvent::CROSS, activator);
+    }
+  } else {
+    bool was_inside = has_inside(activator);
+    if (contains(to) != was_inside) {
+      if (was_inside) {
+        _inside.erase(std::find(_inside.begin(), _inside.end(), activator));
+        notify(TriggerEvent::EXIT, activator);
+      } else {
+        _inside.push_back(activator);
+        notify(TriggerEvent::ENTER, activator);
+      }
+    }
+  }
+}
+
+void Triggers::add_activator(const GameObj* obj) {
+  Activator a;
+  a.obj = obj;
+  a.last_pos = obj->get_pos();
+  _activators.push_back(a);
+}
+
+void Triggers::remove_activator(const GameObj* obj) {
+  for (std::vector<Activator>::iterator i = _activators.begin(); i != _activators.end(); ++i) {
+    if (i->obj == obj) {
+      _activators.erase(i);
+      break;
+    }
+  }
+  
+  BOOST_FOREACH(TriggerVolume* v, _volumes) {
+    std::vector<const GameObj*>::iterator i = std::find(v->_inside.begin(), v->_inside.end(), obj);
+    if (i != v->_inside.end()) {
+      v->_inside.erase(i);
+    }
+  }
+}
+
+void Triggers::resync() {
+  BOOST_FOREACH(TriggerVolume* v, _volumes) {
+    v->_inside.clear();
+  }
+  
+  BOOST_FOREACH(Activator& a, _activators) {
+    a.last_pos = a.obj->get_pos();
+    BOOST_FOREACH(TriggerVolume* v, _volumes) {
+      if (v->contains(a.last_pos)) {
+        v->_inside.push_back(a.obj);
+      }
+    }
+  }
+}
+
+void Triggers::rebase(const Vector& shift) {
+  BOOST_FOREACH(TriggerVolume* v, _volumes) {
+    v->_center -= shift;
+  }
+  BOOST_FOREACH(Activator& a, _activators) {
+    a.last_pos -= shift;
+  }
+}
+
+void Triggers::add_volume(TriggerVolume* volume) {
+  _volumes.push_back(volume);
+}
+
+void Triggers::remove_volume(TriggerVolume* volume) {
+  _volumes.erase(std::find(_volumes.begin(), _volumes.end(), volume));
+}
+
+void Triggers::step() {
+  BOOST_FOREACH(Activator& a, _activators) {
+    const Point& pos = a.obj->get_pos();
+    
+    // Skip over volumes that can't possibly have been reached this step
+    // The bounding sphere of the movement is compared against each volume's bounding radius
+    Point mid = (a.last_pos + pos)/2;
+    float move_rad = a.last_pos.dist_to(pos)/2;
+    
+    BOOST_FOREACH(TriggerVolume* v, _volumes) {
+      float reach = v->_radius + move_rad;
+      if (v->_radius > 0 && mid.sq_dist_to(v->_center) > reach*reach && !v->has_inside(a.obj)) {
+        continue;
+      }
+      v->update(a.obj, a.last_pos, pos);
+    }
+    
+    a.last_pos = pos;
+  }
+}
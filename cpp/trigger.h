@@ -0,0 +1,137 @@
+/*
+trigger.h: Header for trigger volumes and the Triggers class.
+Trigger volumes report objects entering, leaving, or passing through them without going through contact generation.
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+*/
+
+#ifndef ORBIT_RIBBON_TRIGGER_H
+#define ORBIT_RIBBON_TRIGGER_H
+
+#include <boost/array.hpp>
+#include <boost/utility.hpp>
+#include <vector>
+
+#include "geometry.h"
+
+class GameObj;
+class Sim;
+class TriggerVolume;
+
+struct TriggerEvent {
+  enum Type {
+    ENTER, // The activator moved from outside a box or sphere volume to inside it
+    EXIT, // The activator moved from inside a box or sphere volume to outside it
+    CROSS // The activator passed through a plane-crossing volume
+  };
+  
+  Type type;
+  const TriggerVolume* volume;
+  const GameObj* activator;
+  unsigned int step;
+};
+
+class TriggerListener {
+  public:
+    virtual void handle_trigger_event(const TriggerEvent& e) =0;
+};
+
+// A region of space which notifies its listener when an activator enters, exits, or crosses it
+// Volumes are checked by Triggers each step from the time they are constructed until they are destroyed.
+class TriggerVolume : boost::noncopyable {
+  public:
+    enum Shape {
+      BOX,
+      SPHERE,
+      PLANE_CROSSING
+    };
+    
+    // A box centered on center, with the given 3x3 column-major rotation and half-widths along each of its axes
+    TriggerVolume(TriggerListener* listener, const Point& center, const boost::array<float, 9>& rot, const Vector& half_extents);
+    
+    // A sphere
+    TriggerVolume(TriggerListener* listener, const Point& center, float radius);
+    
+    // A disc perpendicular to normal which must be passed through; a radius of zero makes it an unbounded plane
+    TriggerVolume(TriggerListener* listener, const Point& center, const Vector& normal, float radius);
+    
+    ~TriggerVolume();
+    
+    Shape get_shape() const { return _shape; }
+    const Point& get_center() const { return _center; }
+    
+    // Returns true if the point is within this volume; always false for plane-crossing volumes
+    bool contains(const Point& p) const;
+    
+    // Returns true if the line segment from a to b passes through this volume's plane within its radius
+    bool crossed_by(const Point& a, const Point& b) const;
+    
+    // Returns true if the activator was inside this volume as of the last step
+    bool has_inside(const GameObj* activator) const;
+  
+  private:
+    friend class Triggers;
+    
+    Shape _shape;
+    TriggerListener* _listener;
+    Point _center;
+    boost::array<float, 9> _rot;
+    Vector _half_extents;
+    Vector _normal;
+    float _radius;
+    
+    // Activators which were inside as of the last step; there are very rarely more than one
+    std::vector<const GameObj*> _inside;
+    
+    void update(const GameObj* activator, const Point& from, const Point& to);
+    void notify(TriggerEvent::Type type, const GameObj* activator);
+};
+
+// Keeps track of all trigger volumes and of the objects that can set them off
+class Triggers {
+  public:
+    // Only activators set off trigger volumes; the caller has to remove the activator before destroying it
+    static void add_activator(const GameObj* obj);
+    static void remove_activator(const GameObj* obj);
+    
+    // Recomputes which volumes each activator is inside, after activators have been moved other than by stepping
+    static void resync();
+    
+    // Moves every volume and remembered activator position by -shift, following a move of the simulation origin
+    static void rebase(const Vector& shift);
+  
+  private:
+    friend class Sim;
+    friend class TriggerVolume;
+    
+    struct Activator {
+      const GameObj* obj;
+      Point last_pos;
+    };
+    
+    static std::vector<TriggerVolume*> _volumes;
+    static std::vector<Activator> _activators;
+    
+    static void add_volume(TriggerVolume* volume);
+    static void remove_volume(TriggerVolume* volume);
+    
+    // Checks every activator's movement during the last step against every volume
+    static void step();
+};
+
+#endif
@@ -0,0 +1,125 @@
+#!/usr/bin/python
+
+"""
+precision-compare.py: Compares the double and single precision builds of Orbit Ribbon.
+
+Each recording given is replayed at maximum speed by both builds, and this reports the step throughput,
+peak memory use, and how far apart the trajectories of the dynamic bodies end up.
+
+Build both variants first:
+  scons
+  scons single_precision=1 ode_lib=<name of single precision ODE library>
+
+Then run:
+  ./precision-compare.py recording1.orrec [recording2.orrec ...]
+
+Copyright 2011 David Simon <david.mike.simon@gmail.com>
+
+This file is part of Orbit Ribbon.
+
+Orbit Ribbon is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Orbit Ribbon is distributed in the hope that it will be awesome,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Orbit Ribbon.  If not, see http://www.gnu.org/licenses/
+"""
+
+import os, sys, re, math, subprocess, tempfile
+
+VARIANTS = (("double", "./orbit-ribbon"), ("single", "./orbit-ribbon-single"))
+
+# Divergence beyond this many meters is reported as the point where the variants stopped agreeing
+DIVERGENCE_THRESHOLD = 0.01
+
+replay_pat = re.compile(r"Replay finished: (\d+) steps in (\d+) ms")
+
+def run_variant(binary, recording, traj_path):
+  """Replays the recording, returning (steps, ms, peak memory in KB)."""
+  cmd = [binary, "--replay", recording, "--max-speed", "--trajectory-log", traj_path]
+  p = subprocess.Popen(cmd, stdout = subprocess.PIPE, stderr = subprocess.STDOUT)
+  output = p.stdout.read()
+  pid, status, rusage = os.wait4(p.pid, 0)
+  if status != 0:
+    raise RuntimeError("%s exited with status %u:\n%s" % (binary, status, output))
+
+  m = replay_pat.search(output)
+  if m is None:
+    raise RuntimeError("%s did not report replay timing:\n%s" % (binary, output))
+  return (int(m.group(1)), int(m.group(2)), rusage.ru_maxrss)
+
+def read_trajectory(path):
+  """Returns a list of (step, name, position) in the order they were logged."""
+  entries = []
+  for line in open(path):
+    parts = line.rstrip("\n").split(" ", 7)
+    entries.append((int(parts[0]), parts[7], tuple(float(x) for x in parts[1:4])))
+  return entries
+
+def compare_trajectories(a, b):
+  """Returns (maximum distance over the whole run, step it happened at, largest distance of any body at the last
+  logged step, first step beyond the threshold or None)."""
+  max_dist = 0.0
+  max_step = None
+  final_step = None
+  final_dist = 0.0
+  first_diverged = None
+  for (step_a, name_a, pos_a), (step_b, name_b, pos_b) in zip(a, b):
+    if step_a != step_b or name_a != name_b:
+      raise RuntimeError("Trajectory logs are out of step at step %u %s / step %u %s" % (step_a, name_a, step_b, name_b))
+    dist = math.sqrt(sum((pa - pb)**2 for pa, pb in zip(pos_a, pos_b)))
+    if dist > max_dist:
+      max_dist = dist
+      max_step = step_a
+    # Every body is logged each step, so the final distance is the worst of them at the last step, not just the last line
+    if step_a != final_step:
+      final_step = step_a
+      final_dist = 0.0
+    final_dist = max(final_dist, dist)
+    if first_diverged is None and dist > DIVERGENCE_THRESHOLD:
+      first_diverged = step_a
+  if len(a) != len(b):
+    print "  Warning: trajectory logs have different lengths (%u and %u entries)" % (len(a), len(b))
+  return (max_dist, max_step, final_dist, first_diverged)
+
+if len(sys.argv) < 2:
+  print __doc__
+  sys.exit(1)
+
+for name, binary in VARIANTS:
+  if not os.path.isfile(binary):
+    print "Missing %s precision build at %s" % (name, binary)
+    sys.exit(1)
+
+for recording in sys.argv[1:]:
+  print "%s:" % recording
+  trajectories = {}
+  for name, binary in VARIANTS:
+    fd, traj_path = tempfile.mkstemp(suffix = ".traj")
+    os.close(fd)
+    try:
+      steps, ms, maxrss = run_variant(binary, recording, traj_path)
+      trajectories[name] = read_trajectory(traj_path)
+    finally:
+      os.remove(traj_path)
+    print "  %-6s %7u steps in %6u ms, %8.0f steps/sec, peak memory %6u KB" % (
+      name, steps, ms, steps*1000.0/ms if ms > 0 else 0.0, maxrss
+    )
+
+  max_dist, max_step, final_dist, first_diverged = compare_trajectories(trajectories["double"], trajectories["single"])
+  if max_step is None:
+    print "  Trajectory divergence: none, final %.6f m" % final_dist
+  else:
+    print "  Trajectory divergence: max %.6f m at step %u, final %.6f m" % (max_dist, max_step, final_dist)
+  if first_diverged is None:
+    print "  Never diverged by more than %.3f m" % DIVERGENCE_THRESHOLD
+  else:
+    print "  First diverged by more than %.3f m at step %u" % (DIVERGENCE_THRESHOLD, first_diverged)
+    if final_dist <= DIVERGENCE_THRESHOLD:
+      print "  Came back within %.3f m by the end, but the maximum above is what matters" % DIVERGENCE_THRESHOLD